@@ -22,6 +22,7 @@
 #include <Adafruit_GFX.h>
 #ifdef ARDUINO_ARCH_SAMD
   #include <Adafruit_ZeroDMA.h>
+  #include <wiring_private.h> // pinPeripheral(), for EYE_SPI_BUSES
 #endif
 
 #include <Adafruit_SPIFlash.h>
@@ -37,6 +38,7 @@
 #endif
 
 #include "AudioStream.h"
+#include "FlashExtent.h"
 #include "Timer.h"
 
 
@@ -44,20 +46,15 @@
 Adafruit_SPIFlash flash(FLASHCS, &SPI1);
 Adafruit_W25Q16BV_FatFs fatfs(flash);
 
-//SDFileWrapper soundFile("/Evil_Laugh_Mono_LOFI.wav", fatfs);
-//SDFileWrapper soundFile("/Maniacal_Laugh.wav", fatfs);
-SDFileWrapper soundFile("/HelloThere_DS.wav", fatfs);
-WavLoader wavLoader;
-Unsaturated::AudioSamplerStream<int16_t> soundStream;
-
-int16_t soundRingBuf[1024];
 Servo jawServo;
-bool sampleIsPlaying = false;
-bool isTriggered = false;
+volatile bool sampleIsPlaying = false;
+volatile int32_t soundDoneIdx = -1; // Where the last clip stopped, not yet printed
+volatile bool refillPending   = false; // Set by TC5, audioService() loads
 
 //PIR sensor
 int MOTION_SENSOR_PIN = A11;  // SENSE port on HalloWing
-unsigned long lastTriggerTime = 0L;
+volatile unsigned long lastTriggerTime = 0L;
+bool motionPolled = false;    // No EIC line on the pin, primeStream() polls
 
 typedef struct {        // Struct is defined before including config.h --
   int8_t  select;       // pin numbers for each eye's screen select line
@@ -65,7 +62,20 @@ typedef struct {        // Struct is defined before including config.h --
   uint8_t rotation;     // also display rotation.
 } eyeInfo_t;
 
+#ifdef ARDUINO_ARCH_SAMD
+typedef struct {        // Likewise for EYE_SPI_BUSES in config.h: the SPI
+  SPIClass *spi;        // bus for each eye's screen and the SERCOM behind
+  SERCOM   *sercom;     // it (for its DMA trigger), the screen's own data/
+  int8_t    dc;         // command pin, and the SCK and MOSI pins with the
+  int8_t    sck, mosi;  // mux setting each needs once the bus is started
+  EPioType  sckMux,     // (sck -1 if the core already sets them, as for
+            mosiMux;    // the main SPI bus).
+} eyeBus_t;
+#endif
+
 #include "config.h"     // ****** EYEBALL CONFIGURATION IS DONE IN HERE ******
+#include "Eye.h"        // Pixel kernel, reads the eye graphics from config.h
+#include "Profile.h"    // Cycle counts, per stage with PROFILE in config.h
 
 #if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_)
   typedef Adafruit_ST7735  displayType; // Using TFT display(s)
@@ -73,6 +83,16 @@ typedef struct {        // Struct is defined before including config.h --
   typedef Adafruit_SSD1351 displayType; // Using OLED display(s)
 #endif
 
+#if defined(COLOR_12BIT) && !(defined(ARDUINO_ARCH_SAMD) && \
+    (defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_)))
+  #undef COLOR_12BIT // TFT & DMA only, see config.h
+#endif
+#ifdef COLOR_12BIT
+  #define LINE_BYTES (SCREEN_WIDTH * 3 / 2) // RGB444, 2 pixels in 3 bytes
+#else
+  #define LINE_BYTES (SCREEN_WIDTH * 2)     // RGB565
+#endif
+
 // A simple state machine is used to control eye blinks/winks:
 #define NOBLINK 0       // Not currently engaged in a blink
 #define ENBLINK 1       // Eyelid is currently closing
@@ -83,41 +103,245 @@ typedef struct {
   uint32_t startTime;   // Time (micros) of last state change
 } eyeBlink;
 
+typedef struct {        // Parameters of the last frame sent to a screen,
+  uint16_t iScale;      // used by DELTA_RENDER to skip unchanged lines.
+  uint8_t  scleraX;     // An iScale of 0 means the screen contents are
+  uint8_t  scleraY;     // unknown and the next frame is drawn in full.
+  uint8_t  uT;
+  uint8_t  lT;
+} eyeFrame;
+
 #define NUM_EYES (sizeof eyeInfo / sizeof eyeInfo[0]) // config.h pin list
 
+#ifdef EYE_SPI_BUSES // Each eye has a bus to itself
+  #define NUM_BUSES     (sizeof eyeBus / sizeof eyeBus[0])
+  #define EYE_BUS(e)    (e)
+  #define BUS_SPI(b)    (eyeBus[b].spi)
+  #define BUS_SERCOM(b) (eyeBus[b].sercom)
+  #define EYE_DC(e)     (eyeBus[e].dc)
+  static_assert(NUM_BUSES == NUM_EYES, "eyeBus[] needs one line per eye");
+#else                // All eyes take turns on the one
+  #define NUM_BUSES     1
+  #define EYE_BUS(e)    0
+  #define BUS_SPI(b)    (&SPI)
+  #define BUS_SERCOM(b) (&PERIPH_SPI)
+  #define EYE_DC(e)     DISPLAY_DC
+#endif
+
 struct {                // One-per-eye structure
   displayType *display; // -> OLED/TFT object
   eyeBlink     blink;   // Current blink/wink state
+  eyeFrame     drawn;   // What's currently on the screen
 } eye[NUM_EYES];
 
 #ifdef ARDUINO_ARCH_SAMD
   // SAMD boards use DMA (Teensy uses SPI FIFO instead):
-  // Two single-line 128-pixel buffers (16bpp) are used for DMA.
-  // Though you'd think fewer larger transfers would improve speed,
-  // multi-line buffering made no appreciable difference.
-  uint16_t          dmaBuf[2][128];
-  uint8_t           dmaIdx = 0; // Active DMA buffer # (alternate fill/send)
-  Adafruit_ZeroDMA  dma;
-  DmacDescriptor   *descriptor;
+  // A ring of DMA_LINES single-line 128-pixel buffers (16bpp, or 12 with
+  // COLOR_12BIT), each with its own descriptor, chained in a loop so the
+  // DMA engine walks the ring on its own rather than being restarted for
+  // every line.  A descriptor is marked valid once its line is rendered
+  // and invalid again once it's sent; if the DMA catches up with the
+  // renderer it fetches an invalid descriptor and suspends itself, and is
+  // resumed when the next line is ready.  The renderer only has to wait
+  // when it laps the transmitter.
+  // Each SPI bus has a ring and DMA channel of its own.
+  typedef struct {
+    uint16_t          buf[DMA_LINES][128]; // First LINE_BYTES of each used
+    DmacDescriptor   *descriptor[DMA_LINES];
+    Adafruit_ZeroDMA  dma;
+    uint8_t           idx;     // Ring slot the renderer fills next
+    bool              started;
+    volatile uint32_t queued,  // Lines handed to DMA so far
+                      sent;    // Lines DMA has finished sending
+    volatile uint8_t  sentIdx; // Oldest slot not released yet
+    volatile bool     paused;  // Suspended, caught up
+  } dmaRing;
+
+  dmaRing  dmaRings[NUM_BUSES];
+  uint32_t dmaStallCycles = 0; // Time renderer waited for a slot
+
+  static dmaRing *dmaRingOf(Adafruit_ZeroDMA *dma) { // Ring using a channel
+    uint8_t b = 0;
+    while((b < NUM_BUSES - 1) && (&dmaRings[b].dma != dma)) b++;
+    return &dmaRings[b];
+  }
+  // Release the slots of every line DMA is past.  Progress is read from
+  // the channel's write-back descriptor (the one it has fetched, whether
+  // it's sending it or stopped on it as invalid) rather than counted
+  // one per interrupt, since two line ends that come closer together
+  // than the interrupt can be taken set the flag only once.
+  static void dmaRetire(Adafruit_ZeroDMA *dma) {
+    dmaRing *r = dmaRingOf(dma);
+    volatile DmacDescriptor *wb =
+      (volatile DmacDescriptor *)DMAC->WRBADDR.reg + dma->getChannel();
+    uint32_t src = wb->SRCADDR.reg;
+    while((r->sent != r->queued) &&
+          (r->descriptor[r->sentIdx]->SRCADDR.reg != src)) {
+      r->descriptor[r->sentIdx]->BTCTRL.bit.VALID = false;
+      if(++r->sentIdx >= DMA_LINES) r->sentIdx = 0;
+      r->sent++;
+    }
+  }
+  // End of a line's block: release the slots for the renderer
+  static void dma_callback(Adafruit_ZeroDMA *dma) {
+    dmaRetire(dma);
+  }
+  // Channel hit a descriptor that isn't rendered yet
+  static void dma_suspend_callback(Adafruit_ZeroDMA *dma) {
+    dmaRetire(dma);
+    dmaRingOf(dma)->paused = true;
+  }
+#endif
 
-  // DMA transfer-in-progress indicator and callback
-  static volatile bool dma_busy = false;
-  static void dma_callback(Adafruit_ZeroDMA *dma) { dma_busy = false; }
+struct {                // One per SPI bus (only the one, unless config.h
+  eyeTables tables;     // has EYE_SPI_BUSES): lid runs & iris rows for
+  int8_t    eye;        // the frame of this eye (-1 if none) being drawn
+  uint8_t   y, y1;      // on it, which has lines [y, y1) still to render
+  uint8_t   scleraX, scleraY, uT, lT; // with these
+} bus[NUM_BUSES];
+
+#ifdef AUDIO_DMA
+  // TC4 paces a second DMA channel that copies samples straight into the
+  // DAC, out of two AUDIO_BLOCK-sample halves chained in a loop.  The DMA
+  // interrupt fires only when a half has played out, and refills that
+  // half while the other one plays.
+  uint16_t          dacBuf[2][AUDIO_BLOCK];
+  DmacDescriptor   *dacDescriptor[2];
+  Adafruit_ZeroDMA  audioDma;
+  static volatile uint8_t dacHalf = 0; // Half that plays out next
+  static volatile uint8_t dacTail = 0; // Halves left once sound's ended
+#endif
+
+// Every clip in SOUND_DIR, each ready to start from RAM, and the stream the
+// playing one is read through (intro & jaw track come from the bank; with
+// SOUND_LOOP, the stream keeps the start of the clip's loop itself).
+#ifndef SOUND_LOOP
+  #undef  SOUND_LOOP_BLOCKS
+  #define SOUND_LOOP_BLOCKS 0 // Not looping, no need
+#endif
+Unsaturated::SoundBank<int16_t, SOUND_CLIPS, SOUND_INTRO_BYTES,
+  SOUND_JAW_BYTES> soundBank;
+Unsaturated::AudioSamplerStream<int16_t, 2048, 3, 0, 0, SOUND_LOOP_BLOCKS>
+  soundStream;
+
+// What actually plays: the stream converted from the clip's own sample
+// rate to AUDIO_RATE, shifted by SOUND_PITCH
+Unsaturated::AudioResampler<Unsaturated::AudioSamplerStream<int16_t, 2048,
+  3, 0, 0, SOUND_LOOP_BLOCKS>, int16_t, AUDIO_TAPS, AUDIO_BLOCK>
+  soundOut(&soundStream);
+
+// Loudness of the sound as it plays, updated every AUDIO_BLOCK samples
+Unsaturated::EnvelopeFollower jawEnvelope(JAW_ATTACK, JAW_RELEASE);
+
+// The last AUDIO_BLOCK samples out of soundOut, for the jaw envelope
+int16_t soundBlock[AUDIO_BLOCK];
+
+#ifdef FAST_BOOT
+  // SOUND_INDEX is this header and one entry per clip in the bank, in the
+  // order they were added: all a later boot needs to add the same file
+  // again without parsing its header or walking its cluster chain.
+  #define SOUND_INDEX_MAGIC 0x58444953 // "SIDX"
+  typedef struct {
+    uint32_t magic;
+    uint16_t entrySize; // sizeof(soundIndexEntry), so a build that's
+    uint16_t count;     // changed WavInfo starts a fresh index
+  } soundIndexHeader;
+  typedef struct {
+    uint32_t pathHash, fileSize; // Which file, and is it still the same?
+    uint32_t check;              // soundCheck() of its first & last bytes
+    uint32_t address, size;      // Raw flash extent, size 0 if none
+    WavInfo  info;
+  } soundIndexEntry;
+  soundIndexEntry soundIndex[SOUND_CLIPS];
+  uint8_t         soundIndexCount = 0;
+  bool            soundIndexDirty = false; // Bank & file differ, rewrite
+  File            soundDir;                // Clips still being added
+  bool            soundScanning   = false; // from here, if true
 #endif
 
 uint32_t startTime;  // For FPS indicator
 
+#ifdef ARDUINO_ARCH_SAMD
+// DMA trigger and data register for sending on a SERCOM's SPI
+static void sercomDma(SERCOM *s, int *dmac_id, volatile uint32_t **data_reg) {
+  if(s == &sercom0) {
+    *dmac_id  = SERCOM0_DMAC_ID_TX;
+    *data_reg = &SERCOM0->SPI.DATA.reg;
+#if defined SERCOM1
+  } else if(s == &sercom1) {
+    *dmac_id  = SERCOM1_DMAC_ID_TX;
+    *data_reg = &SERCOM1->SPI.DATA.reg;
+#endif
+#if defined SERCOM2
+  } else if(s == &sercom2) {
+    *dmac_id  = SERCOM2_DMAC_ID_TX;
+    *data_reg = &SERCOM2->SPI.DATA.reg;
+#endif
+#if defined SERCOM3
+  } else if(s == &sercom3) {
+    *dmac_id  = SERCOM3_DMAC_ID_TX;
+    *data_reg = &SERCOM3->SPI.DATA.reg;
+#endif
+#if defined SERCOM4
+  } else if(s == &sercom4) {
+    *dmac_id  = SERCOM4_DMAC_ID_TX;
+    *data_reg = &SERCOM4->SPI.DATA.reg;
+#endif
+#if defined SERCOM5
+  } else if(s == &sercom5) {
+    *dmac_id  = SERCOM5_DMAC_ID_TX;
+    *data_reg = &SERCOM5->SPI.DATA.reg;
+#endif
+#if defined SERCOM6 // SAMD51 parts with more SERCOMs
+  } else if(s == &sercom6) {
+    *dmac_id  = SERCOM6_DMAC_ID_TX;
+    *data_reg = &SERCOM6->SPI.DATA.reg;
+#endif
+#if defined SERCOM7
+  } else if(s == &sercom7) {
+    *dmac_id  = SERCOM7_DMAC_ID_TX;
+    *data_reg = &SERCOM7->SPI.DATA.reg;
+#endif
+  }
+}
+#endif
+
 // INITIALIZATION -- runs once at startup ----------------------------------
 
+#ifdef FAST_BOOT
+// True if the USB port is plugged into a computer rather than a power bank
+// (or nothing): a host sends a start-of-frame every millisecond once it's
+// reset the bus, so the frame number moves.  Gives the host up to 250 ms
+// to notice the board.
+static bool usbHostPresent(void) {
+#ifdef ARDUINO_ARCH_SAMD
+  uint16_t fnum = USB->DEVICE.FNUM.bit.FNUM;
+  for(uint8_t i=0; i<25; i++) {
+    delay(10);
+    if(USB->DEVICE.FNUM.bit.FNUM != fnum) return true;
+  }
+  return false;
+#else
+  return true; // No telling, wait for the serial monitor as before
+#endif
+}
+#endif
+
 void setup(void) {
   uint8_t e; // Eye index, 0 to NUM_EYES-1
   int serial_wait = 0;
   Serial.begin(115200);
-  while (!Serial && serial_wait < 30) {
+#ifdef FAST_BOOT
+  bool usbHost = usbHostPresent(); // Serial monitor & logo only if so
+#else
+  bool usbHost = true;
+#endif
+  while (usbHost && !Serial && serial_wait < 30) {
     delay(100);
     serial_wait++;
   }
   randomSeed(analogRead(A3)); // Seed random() from floating analog input
+  profInit();
   
 #ifdef DISPLAY_BACKLIGHT
   // Enable backlight pin, initially off
@@ -127,8 +351,19 @@ void setup(void) {
 
   // Initialize eye objects based on eyeInfo list in config.h:
   for(e=0; e<NUM_EYES; e++) {
+#ifdef EYE_SPI_BUSES // Screen on its own bus, with its own DC pin
+  #if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_) // TFT
+    eye[e].display = new displayType(eyeBus[e].spi, eyeInfo[e].select,
+                                     eyeBus[e].dc, -1);
+  #else // OLED
+    eye[e].display = new displayType(128, 128, eyeBus[e].spi,
+                                     eyeInfo[e].select, eyeBus[e].dc, -1);
+  #endif
+#else
     eye[e].display     = new displayType(eyeInfo[e].select, DISPLAY_DC, -1);
+#endif
     eye[e].blink.state = NOBLINK;
+    eye[e].drawn.iScale = 0;   // Screen contents unknown, draw in full
     // If project involves only ONE eye and NO other SPI devices, its
     // select line can be permanently tied to GND and corresponding pin
     // in config.h set to -1.  Best to use it though.
@@ -164,48 +399,56 @@ void setup(void) {
     eye[e].display->begin();
 #endif
     eye[e].display->setRotation(eyeInfo[e].rotation);
+#ifdef EYE_SPI_BUSES
+    if(eyeBus[e].sck >= 0) { // begin() started the bus, now move its pins
+      pinPeripheral(eyeBus[e].sck , eyeBus[e].sckMux);
+      pinPeripheral(eyeBus[e].mosi, eyeBus[e].mosiMux);
+    }
+#endif
   }
 
 #if defined(LOGO_TOP_WIDTH) || defined(COLOR_LOGO_WIDTH)
-  // I noticed lots of folks getting right/left eyes flipped, or
-  // installing upside-down, etc.  Logo split across screens may help:
-  for(e=0; e<NUM_EYES; e++) { // Another pass, after all screen inits
-    eye[e].display->fillScreen(0);
-    #ifdef LOGO_TOP_WIDTH
-      // Monochrome Adafruit logo is 2 mono bitmaps:
-      eye[e].display->drawBitmap(NUM_EYES*64 - e*128 - 20,
-        0, logo_top, LOGO_TOP_WIDTH, LOGO_TOP_HEIGHT, 0xFFFF);
-      eye[e].display->drawBitmap(NUM_EYES*64 - e*128 - LOGO_BOTTOM_WIDTH/2,
-        LOGO_TOP_HEIGHT, logo_bottom, LOGO_BOTTOM_WIDTH, LOGO_BOTTOM_HEIGHT,
-        0xFFFF);
-    #else
-      // Color sponsor logo is one RGB bitmap:
-      eye[e].display->fillScreen(color_logo[0]);
-      eye[0].display->drawRGBBitmap(
-        (eye[e].display->width()  - COLOR_LOGO_WIDTH ) / 2,
-        (eye[e].display->height() - COLOR_LOGO_HEIGHT) / 2,
-        color_logo, COLOR_LOGO_WIDTH, COLOR_LOGO_HEIGHT);
-    #endif
-    // After logo is drawn
-  }
-  #ifdef DISPLAY_BACKLIGHT
-    int i;
-    for(i=0; i<BACKLIGHT_MAX; i++) { // Fade logo in
-      analogWrite(DISPLAY_BACKLIGHT, i);
-      delay(2);
-    }
-    delay(1400); // Pause for screen layout/orientation
-    for(; i>=0; i--) {
-      analogWrite(DISPLAY_BACKLIGHT, i);
-      delay(2);
-    }
-    for(e=0; e<NUM_EYES; e++) { // Clear display(s)
+  if(usbHost) { // Skip the show when nobody's at the bench to see it
+    // I noticed lots of folks getting right/left eyes flipped, or
+    // installing upside-down, etc.  Logo split across screens may help:
+    for(e=0; e<NUM_EYES; e++) { // Another pass, after all screen inits
       eye[e].display->fillScreen(0);
+      #ifdef LOGO_TOP_WIDTH
+        // Monochrome Adafruit logo is 2 mono bitmaps:
+        eye[e].display->drawBitmap(NUM_EYES*64 - e*128 - 20,
+          0, logo_top, LOGO_TOP_WIDTH, LOGO_TOP_HEIGHT, 0xFFFF);
+        eye[e].display->drawBitmap(NUM_EYES*64 - e*128 - LOGO_BOTTOM_WIDTH/2,
+          LOGO_TOP_HEIGHT, logo_bottom, LOGO_BOTTOM_WIDTH, LOGO_BOTTOM_HEIGHT,
+          0xFFFF);
+      #else
+        // Color sponsor logo is one RGB bitmap:
+        eye[e].display->fillScreen(color_logo[0]);
+        eye[0].display->drawRGBBitmap(
+          (eye[e].display->width()  - COLOR_LOGO_WIDTH ) / 2,
+          (eye[e].display->height() - COLOR_LOGO_HEIGHT) / 2,
+          color_logo, COLOR_LOGO_WIDTH, COLOR_LOGO_HEIGHT);
+      #endif
+      // After logo is drawn
     }
-    delay(100);
-  #else
-    delay(2000); // Pause for screen layout/orientation
-  #endif // DISPLAY_BACKLIGHT
+    #ifdef DISPLAY_BACKLIGHT
+      int i;
+      for(i=0; i<BACKLIGHT_MAX; i++) { // Fade logo in
+        analogWrite(DISPLAY_BACKLIGHT, i);
+        delay(2);
+      }
+      delay(1400); // Pause for screen layout/orientation
+      for(; i>=0; i--) {
+        analogWrite(DISPLAY_BACKLIGHT, i);
+        delay(2);
+      }
+      for(e=0; e<NUM_EYES; e++) { // Clear display(s)
+        eye[e].display->fillScreen(0);
+      }
+      delay(100);
+    #else
+      delay(2000); // Pause for screen layout/orientation
+    #endif // DISPLAY_BACKLIGHT
+  }
 #endif // LOGO_TOP_WIDTH
 
   // One of the displays is configured to mirror on the X axis.  Simplifies
@@ -215,15 +458,29 @@ void setup(void) {
 #if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_) // TFT
   const uint8_t mirrorTFT[]  = { 0x88, 0x28, 0x48, 0xE8 }; // Mirror+rotate
   digitalWrite(eyeInfo[0].select, LOW);
-  digitalWrite(DISPLAY_DC, LOW);
+  digitalWrite(EYE_DC(0), LOW);
   #ifdef ST77XX_MADCTL
-    SPI.transfer(ST77XX_MADCTL); // Current TFT lib
+    BUS_SPI(0)->transfer(ST77XX_MADCTL); // Current TFT lib
   #else
-    SPI.transfer(ST7735_MADCTL); // Older TFT lib
+    BUS_SPI(0)->transfer(ST7735_MADCTL); // Older TFT lib
   #endif
-  digitalWrite(DISPLAY_DC, HIGH);
-  SPI.transfer(mirrorTFT[eyeInfo[0].rotation & 3]);
+  digitalWrite(EYE_DC(0), HIGH);
+  BUS_SPI(0)->transfer(mirrorTFT[eyeInfo[0].rotation & 3]);
   digitalWrite(eyeInfo[0].select , HIGH);
+  #ifdef COLOR_12BIT
+  for(e=0; e<NUM_EYES; e++) { // 12 bits/pixel from here on (logo's done)
+    digitalWrite(eyeInfo[e].select, LOW);
+    digitalWrite(EYE_DC(e), LOW);
+    #ifdef ST77XX_COLMOD
+    BUS_SPI(EYE_BUS(e))->transfer(ST77XX_COLMOD); // Current TFT lib
+    #else
+    BUS_SPI(EYE_BUS(e))->transfer(ST7735_COLMOD); // Older TFT lib
+    #endif
+    digitalWrite(EYE_DC(e), HIGH);
+    BUS_SPI(EYE_BUS(e))->transfer(0x03);          // RGB444
+    digitalWrite(eyeInfo[e].select, HIGH);
+  }
+  #endif
 #else // OLED
   const uint8_t rotateOLED[] = { 0x74, 0x77, 0x66, 0x65 },
                 mirrorOLED[] = { 0x76, 0x67, 0x64, 0x75 }; // Mirror+rotate
@@ -239,59 +496,45 @@ void setup(void) {
 #endif
 
 #ifdef ARDUINO_ARCH_SAMD
-  // Set up SPI DMA on SAMD boards:
-  int                dmac_id;
-  volatile uint32_t *data_reg;
-  if(&PERIPH_SPI == &sercom0) {
-    dmac_id  = SERCOM0_DMAC_ID_TX;
-    data_reg = &SERCOM0->SPI.DATA.reg;
-#if defined SERCOM1
-  } else if(&PERIPH_SPI == &sercom1) {
-    dmac_id  = SERCOM1_DMAC_ID_TX;
-    data_reg = &SERCOM1->SPI.DATA.reg;
-#endif
-#if defined SERCOM2
-  } else if(&PERIPH_SPI == &sercom2) {
-    dmac_id  = SERCOM2_DMAC_ID_TX;
-    data_reg = &SERCOM2->SPI.DATA.reg;
-#endif
-#if defined SERCOM3
-  } else if(&PERIPH_SPI == &sercom3) {
-    dmac_id  = SERCOM3_DMAC_ID_TX;
-    data_reg = &SERCOM3->SPI.DATA.reg;
-#endif
-#if defined SERCOM4
-  } else if(&PERIPH_SPI == &sercom4) {
-    dmac_id  = SERCOM4_DMAC_ID_TX;
-    data_reg = &SERCOM4->SPI.DATA.reg;
-#endif
-#if defined SERCOM5
-  } else if(&PERIPH_SPI == &sercom5) {
-    dmac_id  = SERCOM5_DMAC_ID_TX;
-    data_reg = &SERCOM5->SPI.DATA.reg;
-#endif
+  // Set up SPI DMA on SAMD boards, a channel per bus:
+  for(uint8_t b=0; b<NUM_BUSES; b++) {
+    dmaRing           *r = &dmaRings[b];
+    int                dmac_id;
+    volatile uint32_t *data_reg;
+    sercomDma(BUS_SERCOM(b), &dmac_id, &data_reg);
+    r->dma.allocate();
+    r->dma.setTrigger(dmac_id);
+    r->dma.setAction(DMA_TRIGGER_ACTON_BEAT);
+    for(uint8_t i=0; i<DMA_LINES; i++) {
+      r->descriptor[i] = r->dma.addDescriptor(
+        r->buf[i],          // move data from here
+        (void *)data_reg,   // to here
+        LINE_BYTES,         // this many...
+        DMA_BEAT_SIZE_BYTE, // bytes/hword/words
+        true,               // increment source addr?
+        false);             // increment dest addr?
+      r->descriptor[i]->BTCTRL.bit.BLOCKACT = DMA_BLOCK_ACTION_INT; // Per line
+      r->descriptor[i]->BTCTRL.bit.VALID    = false; // Nothing rendered yet
+    }
+    r->dma.loop(true); // Last descriptor links back to the first
+    r->dma.setCallback(dma_callback);
+    r->dma.setCallback(dma_suspend_callback, DMA_CALLBACK_CHANNEL_SUSPEND);
   }
 
-  dma.allocate();
-  dma.setTrigger(dmac_id);
-  dma.setAction(DMA_TRIGGER_ACTON_BEAT);
-  descriptor = dma.addDescriptor(
-    NULL,               // move data
-    (void *)data_reg,   // to here
-    sizeof dmaBuf[0],   // this many...
-    DMA_BEAT_SIZE_BYTE, // bytes/hword/words
-    true,               // increment source addr?
-    false);             // increment dest addr?
-  dma.setCallback(dma_callback);
-
 #endif // End SAMD-specific SPI DMA init
 
+  lidInit();    // Analyze eyelid maps for the renderer's open-span tables
+  eyeRamInit(); // and copy what fits of the iris & polar maps into RAM
+  for(uint8_t b=0; b<NUM_BUSES; b++) {
+    bus[b].eye = -1; // Nothing being drawn
+    eyeTablesInit(&bus[b].tables);
+  }
+
 #ifdef DISPLAY_BACKLIGHT
   analogWrite(DISPLAY_BACKLIGHT, BACKLIGHT_MAX);
 #endif
 
 
-
 ///// SERVO /////
   jawServo.attach(4); // Using the NeoPixel port
   jawServo.write(0);
@@ -300,100 +543,236 @@ void setup(void) {
 
   Serial.println("Starting SPI Flash\n");
   initFlash();
-  listDirectory("/");
-  
-  if (!wavLoader.open(&soundFile)) {
-    Serial.println("Failed to open the sound file!");
+#ifdef FAST_BOOT
+  soundIndexLoad();
+  soundDir      = File(SOUND_DIR);
+  soundScanning = soundDir && soundDir.isDirectory();
+  while(!soundBank.size() && soundScanStep()); // One to start, frame() adds
+#else                                          // the rest as the eyes run
+  listDirectory(SOUND_DIR, addSound); // Load up the sound bank
+#endif
+  if (!soundBank.size()) {
+    Serial.println("No sounds found in " SOUND_DIR "!");
     while(1);
   }
 
-  Serial.println("Playing " + String(soundFile.fileName().c_str()));
-  Serial.println("SampleRate = " + String(wavLoader.sampleRate()) + "Hz");
-  Serial.println("Length = " + String(wavLoader.numSamples()) + " Samples");
-
-// SOUND INITIALIZATION
-  Unsaturated::AudioSamplerError err;
-  if( Unsaturated::AudioSamplerError::NoErr != (err = soundStream.load(&soundFile)) ) {
-    Serial.println("Unable to load the audio stream reason: " + String(err));
-    while(1);
-  }
-  
   // Setup the Timer
-  Timer_Configure(22050, 60, NULL, &renderSample, &primeStream);
+#ifdef AUDIO_DMA
+  Timer_Configure(AUDIO_RATE, 60, NULL, NULL, &primeStream); // TC4 paces DMA
+#else
+  Timer_Configure(AUDIO_RATE, 60, NULL, &renderSample, &primeStream);
+#endif
   startTime = millis(); // For frame-rate calculation
   analogWriteResolution(10);
   analogWrite(A0, 0);
 
-  while(soundStream.prime()) {
-    Serial.println("Prime");
+#ifdef AUDIO_DMA
+  audioDma.allocate();
+  audioDma.setTrigger(TC4_DMAC_ID_OVF); // One beat per sample period
+  audioDma.setAction(DMA_TRIGGER_ACTON_BEAT);
+  for(uint8_t i=0; i<2; i++) {
+    dacDescriptor[i] = audioDma.addDescriptor(
+      dacBuf[i],                // move data from here
+      (void *)&DAC->DATA.reg,   // to here
+      AUDIO_BLOCK,              // this many...
+      DMA_BEAT_SIZE_HWORD,      // bytes/hword/words
+      true,                     // increment source addr?
+      false);                   // increment dest addr?
+    dacDescriptor[i]->BTCTRL.bit.BLOCKACT = DMA_BLOCK_ACTION_INT;
+  }
+  audioDma.loop(true);
+  audioDma.setCallback(audio_dma_callback);
+#endif
+
+  startPlayback();
+
+  // PIR sensor: handle edges as they happen where the pin has an external
+  // interrupt line, so the sound starts (and the eyes wake) right away.
+  // The refill is in audioService() on the main loop, so a trigger can
+  // cue() the stream anywhere in the middle of prime(); that's safe only
+  // because prime() checks the seek generation again before it takes up
+  // a cue, and read() ignores anything it publishes until it has.
+  pinMode(MOTION_SENSOR_PIN, INPUT);
+  if(digitalPinToInterrupt(MOTION_SENSOR_PIN) != NOT_AN_INTERRUPT) {
+    attachInterrupt(digitalPinToInterrupt(MOTION_SENSOR_PIN),
+      motionChanged, CHANGE);
+    NVIC_SetPriority(EIC_IRQn, 3);
+  } else {
+    motionPolled = true; // Fall back on checking it from primeStream()
+  }
+  motionChanged(); // Pick up a sensor that's already tripped
+}
+
+// PIR sensor changed state.  A rising edge starts the sound if it isn't
+// already playing and wakes the eyes; while the sound plays, primeStream()
+// keeps lastTriggerTime current for as long as the sensor stays tripped.
+// With SOUND_LOOP, a clip with a loop goes round it until the sensor
+// clears.
+void motionChanged(void) {
+  bool tripped = digitalRead(MOTION_SENSOR_PIN);
+#ifdef SOUND_LOOP
+  soundStream.setLooping(tripped); // Round the loop while someone's there
+#endif
+  if(tripped && !sampleIsPlaying) startPlayback();
+  if(tripped || sampleIsPlaying) {
+    lastTriggerTime = millis();  //save last trigger time
   }
-  sampleIsPlaying = true;
-  isTriggered = true;
-  Timer_Start();
 }
 
 void primeStream(void* context) {
   static int divisor = 0;
-  //Serial.println("prime_stream");
-  if(digitalRead(MOTION_SENSOR_PIN)) {  
-    //Proximity triggered
-    if (!isTriggered && !sampleIsPlaying) {
-      sampleIsPlaying = true;
-      soundStream.set_sample_index(0);
-      Timer_Start();
-      isTriggered = true; 
-    }
-    if (sampleIsPlaying) {
-      lastTriggerTime = millis();  //save last trigger time
-    }
-  }
-  else {
-    if(!sampleIsPlaying) {
-      isTriggered = false;
-    }
+  static bool motionLast = false;
+  PROFILE_START(tTick);
+  bool tripped = digitalRead(MOTION_SENSOR_PIN);
+  if(motionPolled && (tripped != motionLast)) {
+    motionLast = tripped;
+    motionChanged();
   }
+  // Edges alone don't say the sensor is still tripped; a clip that runs
+  // past IDLE_TIMEOUT would put the eyes to sleep under a held-high PIR
+  if(tripped && sampleIsPlaying) lastTriggerTime = millis();
   divisor++;
   if (sampleIsPlaying && !(divisor % 5)) {
-    long unsigned meansquared = 0;
-    
-    for (int16_t *ptr = soundRingBuf,  *end = soundRingBuf + (sizeof(soundRingBuf) / sizeof(soundRingBuf[0])); 
-          ptr < end; ptr++) {
-      int16_t val = *ptr;
-      meansquared += val * val;
+    PROFILE_START(tJaw);
+    int angle = soundStream.jaw_level(); // Clip's own jaw track, if any
+    jawServo.write((angle >= 0) ? angle : jawAngle(jawEnvelope.level()));
+    PROFILE_END(PROF_JAW, tJaw);
+  }
+
+  refillPending = true; // Flash reads happen in audioService(), not here
+  PROFILE_END(PROF_TICK, tTick);
+}
+
+// Refill the sound stream from flash, outside of any interrupt.  Called
+// from frame() between eyes, so it overlaps the previous eye's DMA.  Loads
+// blocks until the stream is full or the time budget is spent; while the
+// stream is running low (below AUDIO_REFILL_WATERMARK blocks queued) the
+// budget is ignored, since a dry stream cuts the sound off.
+void audioService(void) {
+  if(!refillPending) return;
+  refillPending = false;
+  PROFILE_START(tRefill);
+  uint32_t t = micros();
+  // Running low: two blocks per read, fewer trips through the filesystem
+  while(soundStream.prime(
+        (soundStream.blocksQueued() < AUDIO_REFILL_WATERMARK) ? 2 : 1)) {
+    if((soundStream.blocksQueued() >= AUDIO_REFILL_WATERMARK) &&
+       ((micros() - t) >= AUDIO_REFILL_BUDGET)) {
+      refillPending = true; // Out of time, pick up again next frame
+      break;
     }
-    meansquared /= (sizeof(soundRingBuf) / sizeof(soundRingBuf[0]));
-    meansquared >>= 16;
-    meansquared *= 90;
-    meansquared >>= 10;
-    meansquared *= meansquared>>1;
-    meansquared *= 10;
-    Serial.println("Servo: " + String(meansquared));
-    jawServo.write(meansquared);
   }
-  
-  while (soundStream.prime()) {
-    Serial.println("Primed stream");
+  PROFILE_END(PROF_REFILL, tRefill);
+}
+
+// Servo angle for a jaw envelope level (mean square of 16-bit samples)
+uint8_t jawAngle(uint32_t meanSquare) {
+  uint32_t a = ((meanSquare >> 16) * 90) >> 10;
+  a *= (a >> 1) * 10;
+  return (a > 180) ? 180 : a;
+}
+
+// Pick the next clip and start it playing from the top.  Its intro is
+// already in RAM, so nothing waits on the flash here.
+void startPlayback(void) {
+#ifdef SOUND_RANDOM
+  soundBank.cue(soundStream, random(soundBank.size()));
+#else
+  soundBank.cue(soundStream, soundBank.nextClip());
+#endif
+  soundOut.setRates(soundStream.sample_rate(), AUDIO_RATE,
+    (uint32_t)(SOUND_PITCH * soundOut.UnityPitch));
+  soundOut.reset();
+  jawEnvelope.reset();
+#ifdef AUDIO_DMA
+  dacTail = 0;
+  dacHalf = 0;
+  fillDacHalf(0);        // Both halves are queued before the
+  fillDacHalf(1);        // first sample period elapses
+  audioDma.startJob();   // Starts from the first descriptor
+#endif
+  sampleIsPlaying = true;
+  Timer_Start();
+}
+
+// Called from the sample (or DMA) interrupt once the stream runs dry
+void stopPlayback(void) {
+  Timer_Disable();
+#ifdef AUDIO_DMA
+  audioDma.abort();      // Next startJob() begins from the top again
+#endif
+  soundDoneIdx = soundStream.sample_index(); // frame() reports it
+  sampleIsPlaying = false;
+  if(digitalRead(MOTION_SENSOR_PIN)) {
+    lastTriggerTime = millis(); // Still tripped at the end, eyes stay up
+  }
+  jawServo.write(0);
+}
+
+#ifdef AUDIO_DMA
+// Read the next AUDIO_BLOCK samples into DAC buffer half h, using the same
+// mapping as renderSample(), by way of soundBlock, and feed the jaw
+// envelope.  A short read means the clip's over (the stream rides out
+// underruns itself): it pads with silence and starts the countdown to
+// stopping once the padded half has played.
+static void fillDacHalf(uint8_t h) {
+  int n = 0;
+  if(!dacTail) {
+    n = soundOut.read(soundBlock, AUDIO_BLOCK);
+    if(n < 0) n = 0;
+    if(n < AUDIO_BLOCK) dacTail = 2; // This half, then the one playing now
+  }
+  for(int i=0; i<n; i++) {
+    int32_t val = soundBlock[i];
+    val += 32768;
+    val &= 0x1ffff;
+    val >>= 7;
+    dacBuf[h][i] = val;
+  }
+  for(int i=n; i<AUDIO_BLOCK; i++) dacBuf[h][i] = 32768 >> 7; // Midpoint
+  if(!soundStream.has_jaw_track()) {
+    PROFILE_START(tJaw);
+    jawEnvelope.add(soundBlock, n);
+    PROFILE_END(PROF_JAW, tJaw);
   }
 }
 
+// A DAC buffer half has played out; refill it while the other one plays
+static void audio_dma_callback(Adafruit_ZeroDMA *dma) {
+  PROFILE_START(tAudio);
+  uint8_t h = dacHalf;
+  dacHalf ^= 1;
+  if(dacTail && !--dacTail) {
+    stopPlayback(); // Last real samples just went out
+  } else {
+    fillDacHalf(h);
+  }
+  PROFILE_END(PROF_AUDIO, tAudio);
+}
+#endif
+
 void renderSample(void* context) {
-  static int16_t* ringBufPtr = soundRingBuf;
-  if (1 != soundStream.read(ringBufPtr, 1)) {
-    Timer_Disable();
-    Serial.println("Sound Done (idx = " + String(soundStream.sample_index()) + ")" );
-    sampleIsPlaying = false;
-    jawServo.write(0);
+  static unsigned int blockIdx = 0; // Next sample's place in soundBlock
+  PROFILE_START(tAudio);
+  if (1 != soundOut.read(&soundBlock[blockIdx], 1)) {
+    stopPlayback();
+    PROFILE_END(PROF_AUDIO, tAudio);
   }
   else {
-    int32_t val = *ringBufPtr;
+    int32_t val = soundBlock[blockIdx];
     val += 32768;
     val &= 0x1ffff;
     val >>= 7;
     analogWrite(A0, (int)val);
-    ringBufPtr++;
-    if (ringBufPtr - soundRingBuf >= (sizeof(soundRingBuf) / sizeof(soundRingBuf[0]))) {
-      ringBufPtr = soundRingBuf;
+    if (++blockIdx >= AUDIO_BLOCK) { // Finished a block
+      blockIdx = 0;
+      if (!soundStream.has_jaw_track()) {
+        PROFILE_START(tJaw);
+        jawEnvelope.add(soundBlock, AUDIO_BLOCK);
+        PROFILE_END(PROF_JAW, tJaw);
+      }
     }
+    PROFILE_END(PROF_AUDIO, tAudio);
   }
 }
 
@@ -416,7 +795,8 @@ void initFlash() {
   Serial.println("Mounted filesystem!");
 }
 
-bool listDirectory(const char* dirName) {
+// Lists a directory, passing each file's path to fileFound() (if not NULL)
+bool listDirectory(const char* dirName, void (*fileFound)(const char *path)) {
   File testDir(dirName);
   if (!testDir) {
     Serial.println("Error, failed to open / directory!");
@@ -435,6 +815,12 @@ bool listDirectory(const char* dirName) {
       Serial.print(" (directory)");
     }
     Serial.println();
+    if (fileFound && !child.isDirectory()) {
+      std::string path(dirName);
+      if (path.empty() || path[path.size() - 1] != '/') path += '/';
+      path += child.name();
+      fileFound(path.c_str());
+    }
     // Keep calling openNextFile to get a new file.
     // When you're done enumerating files an unopened one will
     // be returned (i.e. testing it for true/false like at the
@@ -444,12 +830,407 @@ bool listDirectory(const char* dirName) {
   return true;
 }
 
+// listDirectory() callback: add any .wav file to the sound bank
+void addSound(const char *path) {
+  size_t len = strlen(path);
+  if ((len < 4) || strcasecmp(path + len - 4, ".wav")) return;
+  FileWrapper *file = new SDFileWrapper(path, fatfs);
+#ifdef SOUND_RAW_FLASH
+  uint32_t address, size;
+  if (FlashExtentFileWrapper::locate(*file, flash, &address, &size)) {
+    delete file; // Unfragmented, read it straight from the flash
+    file = new FlashExtentFileWrapper(path, flash, address, size);
+    Serial.println("  Raw flash @ 0x" + String(address, HEX));
+  }
+#endif
+  if (!soundBank.add(file)) {
+    Serial.println("  Skipped (bank full, or not 16-bit PCM or mono IMA ADPCM)");
+    delete file;
+    return;
+  }
+  printSound(soundBank.size() - 1);
+}
+
+// Print what the sound bank knows about one clip
+void printSound(uint8_t clip) {
+  const WavInfo &info = soundBank.info(clip);
+  Serial.println("  SampleRate = " + String(info.format.sample_rate) + "Hz");
+  Serial.println("  Length = " + String(info.length) + " Samples");
+  if (info.jaw_frames) {
+    Serial.println("  Jaw track = " + String(info.jaw_frames) + " frames @ " + String(info.jaw_rate) + "Hz");
+  }
+}
+
+#ifdef FAST_BOOT
+// FNV-1a, to recognize a path in SOUND_INDEX without storing it
+static uint32_t pathHash(const char *s) {
+  uint32_t h = 2166136261UL;
+  while(*s) h = (h ^ (uint8_t)*s++) * 16777619UL;
+  return h;
+}
+
+// FNV-1a of a clip's first sector and last 16 bytes, read through FatFs,
+// so a file replaced by another of the same size isn't taken for the one
+// in SOUND_INDEX.  With raw set (SOUND_RAW_FLASH), the same bytes must
+// also be at that flash address, or the extent the index has is stale.
+// False if they aren't, or the file can't be read.
+static bool soundCheck(FileWrapper &f, bool raw, uint32_t address,
+  uint32_t *hash) {
+  uint8_t  buf[32];
+  uint32_t h = 2166136261UL;
+  if(!f.open()) return false;
+  long size = f.size();
+  bool ok   = (size >= 16);
+  for(uint8_t part=0; ok && (part<2); part++) {
+    uint32_t pos = part ? (size - 16) : 0,
+             end = (part || (size < 512)) ? size : 512;
+    ok = f.seek(pos);
+    while(ok && (pos < end)) {
+      uint32_t n = ((end - pos) < sizeof buf) ? (end - pos) : sizeof buf;
+      ok = (f.read(buf, n) == n);
+#ifdef SOUND_RAW_FLASH
+      uint8_t flashBuf[sizeof buf];
+      if(ok && raw) ok = (flash.readBuffer(address + pos, flashBuf, n) == n) &&
+        !memcmp(buf, flashBuf, n);
+#endif
+      for(uint32_t i=0; ok && (i<n); i++) h = (h ^ buf[i]) * 16777619UL;
+      pos += n;
+    }
+  }
+  f.close();
+  *hash = h;
+  return ok;
+}
+
+// Read SOUND_INDEX into soundIndex[], if there's one from a build with the
+// same record layout; otherwise the index starts out empty.
+void soundIndexLoad(void) {
+  soundIndexHeader h;
+  soundIndexCount = 0;
+  File f = fatfs.open(SOUND_INDEX, FILE_READ);
+  if(!f) return;
+  if((f.read(&h, sizeof h) == sizeof h) && (h.magic == SOUND_INDEX_MAGIC) &&
+     (h.entrySize == sizeof(soundIndexEntry)) && (h.count <= SOUND_CLIPS) &&
+     (f.read(soundIndex, h.count * sizeof(soundIndexEntry)) ==
+      (int)(h.count * sizeof(soundIndexEntry)))) {
+    soundIndexCount = h.count;
+  }
+  f.close();
+}
+
+// Write soundIndex[] (one entry per clip in the bank) out to SOUND_INDEX.
+// Main loop only, and not while a clip plays: the flash erase takes long
+// enough to starve the sound stream.
+void soundIndexSave(void) {
+  soundIndexHeader h = { SOUND_INDEX_MAGIC, sizeof(soundIndexEntry),
+    soundIndexCount };
+  soundIndexDirty = false;
+  fatfs.remove(SOUND_INDEX); // FILE_WRITE would append to the old one
+  File   f = fatfs.open(SOUND_INDEX, FILE_WRITE);
+  size_t n = soundIndexCount * sizeof(soundIndexEntry);
+  if(!f || (f.write((const uint8_t *)&h, sizeof h) != sizeof h) ||
+     (f.write((const uint8_t *)soundIndex, n) != n)) {
+    Serial.println("Couldn't write " SOUND_INDEX);
+  }
+  if(f) f.close();
+}
+
+// Add the next .wav file in SOUND_DIR to the sound bank, taking its header
+// and flash extent from SOUND_INDEX if the index has a file there by that
+// name and size and soundCheck() agrees it's the same one.  Returns false
+// once the directory's run out (or the bank's full), at which point the
+// index is brought up to date.  With SOUND_RAW_FLASH a clip the index
+// doesn't know waits until no sound is playing: locate() reads the
+// directory and FAT off the flash, more than the stream can cover for.
+bool soundScanStep(void) {
+  static std::string path;     // File being added, empty if none
+  static uint32_t    fileSize;
+  if(!soundScanning) return false;
+  for(;; path.clear()) {
+    if(path.empty()) {
+      File child = soundDir.openNextFile();
+      if(!child || (soundBank.size() >= SOUND_CLIPS)) break;
+      if(child.isDirectory()) continue;
+      path = SOUND_DIR;
+      if(path.empty() || path[path.size() - 1] != '/') path += '/';
+      path += child.name();
+      fileSize = child.size();
+      child.close();
+      if((path.size() < 4) ||
+         strcasecmp(path.c_str() + path.size() - 4, ".wav")) continue;
+    }
+
+    // Look for it in the index from this clip's slot on, entries for the
+    // clips already in the bank having been moved to the slots before it
+    uint8_t  n = soundBank.size(), j;
+    uint32_t hash = pathHash(path.c_str());
+    for(j=n; (j < soundIndexCount) && ((soundIndex[j].pathHash != hash) ||
+      (soundIndex[j].fileSize != fileSize)); j++);
+    bool known = (j < soundIndexCount);
+    soundIndexEntry entry;
+    FileWrapper *file = new SDFileWrapper(path.c_str(), fatfs);
+    uint32_t check;
+    if(known) {
+      entry = soundIndex[j];
+      if(!soundCheck(*file, entry.size != 0, entry.address, &check) ||
+         (check != entry.check)) {
+        known           = false; // Same name and size, different file
+        soundIndexDirty = true;
+      }
+    }
+    if(!known) {
+#ifdef SOUND_RAW_FLASH
+      if(sampleIsPlaying) {
+        delete file;
+        return true; // Try again once it's quiet
+      }
+#endif
+      entry.pathHash = hash;
+      entry.fileSize = fileSize;
+      entry.size     = 0; // Through FatFs unless found unfragmented
+      if(!soundCheck(*file, false, 0, &entry.check)) entry.check = 0;
+    }
+
+#ifdef SOUND_RAW_FLASH
+    if(!known && !FlashExtentFileWrapper::locate(*file, flash,
+      &entry.address, &entry.size)) entry.size = 0;
+    if(entry.size) { // Unfragmented, read it straight from the flash
+      delete file;
+      file = new FlashExtentFileWrapper(path.c_str(), flash, entry.address,
+        entry.size);
+    }
+#endif
+    if(!(known ? soundBank.add(file, entry.info) : soundBank.add(file))) {
+      delete file; // Bank full, or not a format it plays
+      soundIndexDirty |= known;
+      continue;
+    }
+    if(!known) {
+      entry.info      = soundBank.info(n);
+      soundIndexDirty = true;
+    }
+    if(known) soundIndex[j] = soundIndex[n]; // Swap, keep the one displaced
+    soundIndex[n] = entry;
+    if(n >= soundIndexCount) soundIndexCount = n + 1;
+    path.clear();
+    return true;
+  }
+
+  soundDir.close();
+  soundScanning = false;
+  if(soundIndexCount != soundBank.size()) { // Entries for files since gone
+    soundIndexCount = soundBank.size();
+    soundIndexDirty = true;
+  }
+  return false;
+}
+#endif // FAST_BOOT
+
 
 // EYE-RENDERING FUNCTION --------------------------------------------------
 
 SPISettings settings(SPI_FREQ, MSBFIRST, SPI_MODE0);
 
-void drawEye( // Renders one eye.  Inputs must be pre-clipped & valid.
+#ifdef PACKED_EYES
+// Switch to packed eye n.  Call between frames, not from an interrupt:
+// frames still being drawn are finished off with the old maps, the lid
+// and iris tables (and any RAM copies) are rebuilt for the new ones, and
+// each eye's next frame is drawn in full.
+void eyeStyleSet(uint8_t n) {
+  if((n >= PACKED_EYES) || (eyeStyle == &packedEyes[n])) return;
+  drawEyeFinish();
+  eyeStyle     = &packedEyes[n];
+  lidInit();
+  eyeRamInit();
+  for(uint8_t b=0; b<NUM_BUSES; b++) eyeTablesInit(&bus[b].tables);
+  for(uint8_t e=0; e<NUM_EYES; e++) eye[e].drawn.iScale = 0;
+}
+#endif
+
+#ifdef ARDUINO_ARCH_SAMD
+// Pick a ring's DMA back up if it suspended after running out of lines
+static inline void dmaKick(dmaRing *r) {
+  if(r->paused) {
+    r->paused = false;
+    r->dma.resume(); // Fetches the (now valid) descriptor again
+  }
+}
+
+// Hand the line in ring slot idx to DMA and advance to the next slot
+static void dmaQueue(dmaRing *r) {
+  r->descriptor[r->idx]->BTCTRL.bit.VALID = true;
+  r->queued++;
+  if(++r->idx >= DMA_LINES) r->idx = 0;
+  if(r->started) {
+    dmaKick(r);
+  } else {           // Channel runs continuously from the first line on,
+    r->dma.startJob(); // pausing whenever the ring is empty
+    r->started = true;
+  }
+}
+
+// eyeLines() sink: each line is built in a DMA ring slot, byte-swapped
+// for the display, and queued as soon as it's done.  The slot must be
+// free already (busRoom()).
+struct DmaSink {
+  dmaRing  *ring;
+  uint16_t *ptr;
+  void begin(uint8_t y) { ptr = &ring->buf[ring->idx][0]; }
+  void pixel(uint16_t p) { *ptr++ = __builtin_bswap16(p); }
+  void black(uint8_t n)  { memset(ptr, 0, n * sizeof *ptr); ptr += n; }
+  void end(void) { dmaQueue(ring); } // DMA picks it up when it gets there
+};
+
+// Same for COLOR_12BIT: each pixel is cut down to RGB444 and pairs of
+// them are packed into 3 bytes (lines are always an even width).
+struct DmaSink12 {
+  dmaRing *ring;
+  uint8_t *ptr;
+  int16_t  held; // First pixel of a pair, -1 if none
+  void begin(uint8_t y) {
+    ptr  = (uint8_t *)&ring->buf[ring->idx][0];
+    held = -1;
+  }
+  void pixel(uint16_t p) {
+    int16_t c = ((p >> 4) & 0xF00) | ((p >> 3) & 0x0F0) | ((p >> 1) & 0x00F);
+    if(held < 0) {
+      held = c;
+    } else {
+      ptr[0] = held >> 4;
+      ptr[1] = (held << 4) | (c >> 8);
+      ptr[2] = c;
+      ptr   += 3;
+      held   = -1;
+    }
+  }
+  void black(uint8_t n) {
+    if(n && (held >= 0)) { pixel(0); n--; } // Finish the pair
+    memset(ptr, 0, n / 2 * 3);
+    ptr += n / 2 * 3;
+    if(n & 1) held = 0;
+  }
+  void end(void) { dmaQueue(ring); }
+};
+#else
+// eyeLines() sink: pixels go straight out the SPI FIFO, technique from
+// Paul Stoffregen's ILI9341_t3 library
+struct FifoSink {
+  void begin(uint8_t y) { }
+  void pixel(uint16_t p) {
+    while(KINETISK_SPI0.SR & 0xC000); // FIFO space
+    KINETISK_SPI0.PUSHR = p | SPI_PUSHR_CTAS(1) | SPI_PUSHR_CONT;
+  }
+  void black(uint8_t n) { while(n--) pixel(0); }
+  void end(void) { }
+};
+#endif
+
+// Drawing is split up so the CPU isn't left idling while scanlines drain
+// out over SPI, and so that with EYE_SPI_BUSES every eye's screen is fed
+// at once.  drawEye() starts a frame on its eye's bus and renders lines
+// until the DMA ring is full, leaving the display selected; the rest of
+// the frame is rendered whenever the drawing code is next waiting on a
+// bus, a line at a time on each bus that has room for one, so lines for
+// all the eyes are interleaved and their transfers overlap.  drawEye()
+// finishes whatever's left of a bus' previous frame itself before
+// starting another, so the simple case of calling drawEye() over and
+// over needs nothing more.  drawEyeFinish() gets every frame out and
+// releases the displays & SPI buses.
+
+static bool busRoom(uint8_t b) { // True if bus b can take another line now
+#ifdef ARDUINO_ARCH_SAMD
+  dmaRing *r = &dmaRings[b];
+  dmaKick(r);
+  return (r->queued - r->sent) < DMA_LINES;
+#else
+  return true; // FifoSink waits on the FIFO itself
+#endif
+}
+
+static bool busIdle(uint8_t b) { // True once everything sent on bus b
+#ifdef ARDUINO_ARCH_SAMD
+  dmaRing *r = &dmaRings[b];
+  dmaKick(r);
+  return r->sent == r->queued;             // All lines sent
+#else
+  return !(KINETISK_SPI0.SR & 0xF000) &&   // SPI FIFO empty
+          (KINETISK_SPI0.SR & SPI_SR_TCF); // and last bit out
+#endif
+}
+
+// Render the next line on every bus that has one to go and room for it.
+// Returns false if there was none.
+static bool drawEyeStep(void) {
+  bool drew = false;
+  for(uint8_t b=0; b<NUM_BUSES; b++) {
+    if((bus[b].y >= bus[b].y1) || !busRoom(b)) continue;
+#if defined(COLOR_12BIT)
+    DmaSink12 sink = { &dmaRings[b] };
+#elif defined(ARDUINO_ARCH_SAMD)
+    DmaSink  sink = { &dmaRings[b] };
+#else
+    FifoSink sink;
+#endif
+    eyeLine(sink, &bus[b].tables, bus[b].scleraX, bus[b].scleraY,
+      bus[b].uT, bus[b].lT, bus[b].y++);
+#ifndef ARDUINO_ARCH_SAMD
+    if(bus[b].y >= bus[b].y1) {       // Clear transfer flag while FIFO's
+      KINETISK_SPI0.SR |= SPI_SR_TCF; // full, after the frame's last line
+    }
+#endif
+    drew = true;
+  }
+  return drew;
+}
+
+// Render the rest of bus b's frame (and others' lines meanwhile),
+// counting CPU cycles spent stalled on full rings
+static void busRender(uint8_t b) {
+  while(bus[b].y < bus[b].y1) {
+    uint32_t t = profCycles();
+    if(!drawEyeStep()) {
+#ifdef ARDUINO_ARCH_SAMD
+      dmaStallCycles += profCycles() - t;
+#endif
+    }
+  }
+}
+
+// Get bus b's frame all out and release its display & bus.  Returns CPU
+// cycles spent waiting on the last lines to go.
+static uint32_t busFinish(uint8_t b) {
+  uint32_t waited = 0;
+  busRender(b);
+  while(!busIdle(b)) {
+    uint32_t t = profCycles();
+    if(!drawEyeStep()) waited += profCycles() - t;
+  }
+  if(bus[b].eye >= 0) {
+    digitalWrite(eyeInfo[bus[b].eye].select, HIGH); // Deselect
+    BUS_SPI(b)->endTransaction();
+    bus[b].eye = -1;
+  }
+  return waited;
+}
+
+void drawEyeFinish(void) { // Wait for all frames to go out
+  for(uint8_t b=0; b<NUM_BUSES; b++) busFinish(b);
+}
+
+#ifdef PROFILE
+// Record one drawEye() call, started at profCycles() tDraw: tWait cycles
+// (plus DMA ring stalls since the count was stalls) as display, the rest
+// as pixels
+static void profDraw(uint32_t tDraw, uint32_t tWait, uint32_t stalls) {
+#ifdef ARDUINO_ARCH_SAMD
+  tWait += dmaStallCycles - stalls;
+#endif
+  profAdd(PROF_DISPLAY, tWait);
+  profAdd(PROF_PIXELS, profCycles() - tDraw - tWait);
+}
+#endif
+
+void drawEye( // Starts one eye.  Inputs must be pre-clipped & valid.
   uint8_t  e,       // Eye array index; 0 or 1 for left/right
   uint32_t iScale,  // Scale factor for iris
   uint8_t  scleraX, // First pixel X offset into sclera image
@@ -457,135 +1238,153 @@ void drawEye( // Renders one eye.  Inputs must be pre-clipped & valid.
   uint8_t  uT,      // Upper eyelid threshold value
   uint8_t  lT) {    // Lower eyelid threshold value
 
-  uint8_t  screenX, screenY, scleraXsave;
-  int16_t  irisX, irisY;
-  uint16_t p, a;
-  uint32_t d;
+  int16_t    irisY;
+  uint8_t    b = EYE_BUS(e), y0 = 0, y1 = SCREEN_HEIGHT; // Lines to draw
+  eyeTables *tables = &bus[b].tables;
+  PROFILE_START(tDraw);
+#ifdef PROFILE
+  #ifdef ARDUINO_ARCH_SAMD
+  uint32_t stalls = dmaStallCycles; // Only the stalls from here on count
+  #else
+  uint32_t stalls = 0;
+  #endif
+#endif
+
+  busRender(b); // Bus' previous frame is still using its tables
+
+#ifdef DELTA_RENDER
+  // Compare against what's already on the screen and narrow the redraw to
+  // the scanlines that can differ.  Moving the eye changes the whole
+  // screen; moving the lids changes only the lines whose open runs moved,
+  // and an iris scale change alone only touches the iris rows.
+  eyeFrame *drawn = &eye[e].drawn;
+  if(drawn->iScale && (drawn->scleraX == scleraX) &&
+     (drawn->scleraY == scleraY)) {
+    y0 = SCREEN_HEIGHT; // Eye didn't move, start with an empty band
+    y1 = 0;
+    if((drawn->uT != uT) || (drawn->lT != lT)) { // Lids moved
+      if((tables->spanUT == drawn->uT) && (tables->spanLT == drawn->lT)) {
+        lidSpans(tables, uT, lT, &y0, &y1); // Add lines whose runs changed
+      } else {                      // Runs are from another eye,
+        y0 = 0;                     // can't compare, draw everything
+        y1 = SCREEN_HEIGHT;
+      }
+    }
+    if((drawn->iScale != iScale) && (lT != 255)) { // Iris changed & visible
+      irisY = scleraY - (SCLERA_HEIGHT - IRIS_HEIGHT) / 2; // Row 0 in iris
+      int16_t iy0 = (irisY < 0) ? -irisY : 0,  // Screen lines that
+              iy1 = IRIS_HEIGHT - irisY;       // cross the iris square
+      if(iy1 > SCREEN_HEIGHT) iy1 = SCREEN_HEIGHT;
+      if(y0  > iy0)           y0  = iy0;
+      if(y1  < iy1)           y1  = iy1;
+    }
+    if(y0 >= y1) { // Nothing changed, skip the frame
+#ifdef PROFILE
+      profDraw(tDraw, 0, stalls); // busRender() above still counts
+#endif
+      return;
+    }
+  }
+  drawn->iScale  = iScale;
+  drawn->scleraX = scleraX;
+  drawn->scleraY = scleraY;
+  drawn->uT      = uT;
+  drawn->lT      = lT;
+#endif
+
+  lidSpans(tables, uT, lT, NULL, NULL); // Open run of each line for lids
+  irisRows(tables, iScale);             // iris[] row per polar distance
 
+  // Time spent waiting on the display isn't pixel work: the bus' last
+  // frame draining here, and any stalls on full DMA rings
+#ifdef PROFILE
+  uint32_t tWait = busFinish(b);
+#else
+  busFinish(b); // Prior frame on this bus must be out first
+#endif
 
-  // Set up raw pixel dump to entire screen.  Although such writes can wrap
-  // around automatically from end of rect back to beginning, the region is
-  // reset on each frame here in case of an SPI glitch.
-  SPI.beginTransaction(settings);
+  // Set up raw pixel dump to the band of scanlines being drawn.  Although
+  // such writes can wrap around automatically from end of rect back to
+  // beginning, the region is reset on each frame here in case of an SPI
+  // glitch.
+  BUS_SPI(b)->beginTransaction(settings);
   digitalWrite(eyeInfo[e].select, LOW);                        // Chip select
 #if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_) // TFT
-  eye[e].display->setAddrWindow(0, 0, 128, 128);
+  eye[e].display->setAddrWindow(0, y0, 128, y1 - y0);
 #else // OLED
   eye[e].display->writeCommand(SSD1351_CMD_SETROW);    // Y range
-  eye[e].display->writeData(0); eye[e].display->writeData(SCREEN_HEIGHT - 1);
+  eye[e].display->writeData(y0); eye[e].display->writeData(y1 - 1);
   eye[e].display->writeCommand(SSD1351_CMD_SETCOLUMN); // X range
   eye[e].display->writeData(0); eye[e].display->writeData(SCREEN_WIDTH  - 1);
   eye[e].display->writeCommand(SSD1351_CMD_WRITERAM);  // Begin write
 #endif
   digitalWrite(eyeInfo[e].select, LOW);                // Re-chip-select
-  digitalWrite(DISPLAY_DC, HIGH);                      // Data mode
-  // Now just issue raw 16-bit values for every pixel...
-
-  //PIR sensor check trigger times
-  if((millis() - lastTriggerTime) <= 3500) {  // draw because PIR tripped
-    scleraXsave = scleraX; // Save initial X value to reset on each line
-    irisY       = scleraY - (SCLERA_HEIGHT - IRIS_HEIGHT) / 2;
-    for(screenY=0; screenY<SCREEN_HEIGHT; screenY++, scleraY++, irisY++) {
-  #ifdef ARDUINO_ARCH_SAMD
-      uint16_t *ptr = &dmaBuf[dmaIdx][0];
-  #endif
-      scleraX = scleraXsave;
-      irisX   = scleraXsave - (SCLERA_WIDTH - IRIS_WIDTH) / 2;
-      for(screenX=0; screenX<SCREEN_WIDTH; screenX++, scleraX++, irisX++) {
-        if((lower[screenY][screenX] <= lT) ||
-           (upper[screenY][screenX] <= uT)) {             // Covered by eyelid
-          p = 0;
-        } else if((irisY < 0) || (irisY >= IRIS_HEIGHT) ||
-                  (irisX < 0) || (irisX >= IRIS_WIDTH)) { // In sclera
-          p = sclera[scleraY][scleraX];
-        } else {                                          // Maybe iris...
-          p = polar[irisY][irisX];                        // Polar angle/dist
-          d = (iScale * (p & 0x7F)) / 128;                // Distance (Y)
-          if(d < IRIS_MAP_HEIGHT) {                       // Within iris area
-            a = (IRIS_MAP_WIDTH * (p >> 7)) / 512;        // Angle (X)
-            p = iris[d][a];                               // Pixel = iris
-          } else {                                        // Not in iris
-            p = sclera[scleraY][scleraX];                 // Pixel = sclera
-          }
-        }
-  #ifdef ARDUINO_ARCH_SAMD
-        *ptr++ = __builtin_bswap16(p); // DMA: store in scanline buffer
-  #else
-        // SPI FIFO technique from Paul Stoffregen's ILI9341_t3 library:
-        while(KINETISK_SPI0.SR & 0xC000); // Wait for space in FIFO
-        KINETISK_SPI0.PUSHR = p | SPI_PUSHR_CTAS(1) | SPI_PUSHR_CONT;
-  #endif
-      } // end column
-  #ifdef ARDUINO_ARCH_SAMD
-      while(dma_busy); // Wait for prior DMA xfer to finish
-      descriptor->SRCADDR.reg = (uint32_t)&dmaBuf[dmaIdx] + sizeof dmaBuf[0];
-      dma_busy = true;
-      dmaIdx   = 1 - dmaIdx;
-      dma.startJob();
-  #endif
-    } // end scanline
-  }
+  digitalWrite(EYE_DC(e), HIGH);                       // Data mode
+
+  // Now just issue raw 16-bit (or 12-bit) values for every pixel, as many
+  // lines as the rings will take for now
+  bus[b].eye     = e;
+  bus[b].scleraX = scleraX;
+  bus[b].scleraY = scleraY;
+  bus[b].uT      = uT;
+  bus[b].lT      = lT;
+  bus[b].y       = y0;
+  bus[b].y1      = y1;
+  while(drawEyeStep());
+
+#ifdef PROFILE
+  profDraw(tDraw, tWait, stalls);
+#endif
+}
 
-  else {  //don't draw because PIR didn't trip
-    scleraXsave = scleraX; // Save initial X value to reset on each line
-    irisY       = scleraY - (SCLERA_HEIGHT - IRIS_HEIGHT) / 2;
-    for(screenY=0; screenY<SCREEN_HEIGHT; screenY++, scleraY++, irisY++) {
-  #ifdef ARDUINO_ARCH_SAMD
-      uint16_t *ptr = &dmaBuf[dmaIdx][0];
-  #endif
-      scleraX = scleraXsave;
-      irisX   = scleraXsave - (SCLERA_WIDTH - IRIS_WIDTH) / 2;
-      for(screenX=0; screenX<SCREEN_WIDTH; screenX++, scleraX++, irisX++) {
-        if((lower[screenY][screenX] <= lT) ||
-           (upper[screenY][screenX] <= uT)) {             // Covered by eyelid
-          p = 0;
-        } else if((irisY < 0) || (irisY >= IRIS_HEIGHT) ||
-                  (irisX < 0) || (irisX >= IRIS_WIDTH)) { // In sclera
-          //p = sclera[scleraY][scleraX];
-          p = 0;
-        } else {                                          // Maybe iris...
-          //p = polar[irisY][irisX];                        // Polar angle/dist
-          p=0;
-          d = (iScale * (p & 0x7F)) / 128;                // Distance (Y)
-          if(d < IRIS_MAP_HEIGHT) {                       // Within iris area
-            a = (IRIS_MAP_WIDTH * (p >> 7)) / 512;        // Angle (X)
-            //p = iris[d][a];                               // Pixel = iris
-            p=0;
-          } else {                                        // Not in iris
-            //p = sclera[scleraY][scleraX];                 // Pixel = sclera
-            p=0;
-          }
-        }
-  #ifdef ARDUINO_ARCH_SAMD
-        *ptr++ = __builtin_bswap16(p); // DMA: store in scanline buffer
-  #else
-        // SPI FIFO technique from Paul Stoffregen's ILI9341_t3 library:
-        while(KINETISK_SPI0.SR & 0xC000); // Wait for space in FIFO
-        KINETISK_SPI0.PUSHR = p | SPI_PUSHR_CTAS(1) | SPI_PUSHR_CONT;
-  #endif
-      } // end column
-  #ifdef ARDUINO_ARCH_SAMD
-      while(dma_busy); // Wait for prior DMA xfer to finish
-      descriptor->SRCADDR.reg = (uint32_t)&dmaBuf[dmaIdx] + sizeof dmaBuf[0];
-      dma_busy = true;
-      dmaIdx   = 1 - dmaIdx;
-      dma.startJob();
-  #endif
-    } // end scanline
-  }
 
+// IDLE STATE --------------------------------------------------------------
 
+// When the PIR sensor hasn't tripped for IDLE_TIMEOUT milliseconds the
+// displays are switched off (and backlight, if any) rather than being fed
+// black frames, and the CPU sleeps between interrupts.  primeStream(), on
+// TC5, keeps lastTriggerTime current while the sensor is tripped during
+// playback, and the pin-change interrupt (or primeStream()'s polling, on
+// a pin without one) bumps it when the sensor fires; the next frame()
+// call switches everything back on.
+bool eyesAsleep = false;
 
-#ifdef ARDUINO_ARCH_SAMD
-  while(dma_busy);  // Wait for last scanline to transmit
-#else
-  KINETISK_SPI0.SR |= SPI_SR_TCF;         // Clear transfer flag
-  while((KINETISK_SPI0.SR & 0xF000) ||    // Wait for SPI FIFO to drain
-       !(KINETISK_SPI0.SR & SPI_SR_TCF)); // Wait for last bit out
+static void displayPower(bool on) { // Switch all displays on or off
+  for(uint8_t e=0; e<NUM_EYES; e++) {
+    SPIClass *spi = BUS_SPI(EYE_BUS(e));
+    spi->beginTransaction(settings);
+    digitalWrite(eyeInfo[e].select, LOW);
+#if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_) // TFT
+    digitalWrite(EYE_DC(e), LOW);
+  #ifdef ST77XX_DISPON
+    spi->transfer(on ? ST77XX_DISPON : ST77XX_DISPOFF); // Current TFT lib
+  #else
+    spi->transfer(on ? ST7735_DISPON : ST7735_DISPOFF); // Older TFT lib
+  #endif
+    digitalWrite(EYE_DC(e), HIGH);
+#else // OLED
+    eye[e].display->writeCommand(on ? SSD1351_CMD_DISPLAYON :
+                                      SSD1351_CMD_DISPLAYOFF);
+#endif
+    digitalWrite(eyeInfo[e].select, HIGH);
+    spi->endTransaction();
+  }
+#ifdef DISPLAY_BACKLIGHT
+  analogWrite(DISPLAY_BACKLIGHT, on ? BACKLIGHT_MAX : 0);
 #endif
+}
 
-  digitalWrite(eyeInfo[e].select, HIGH);          // Deselect
-  SPI.endTransaction();
+void eyesSleep(void) {
+  if(eyesAsleep) return;
+  drawEyeFinish(); // Let the last frame out & release the bus
+  displayPower(false);
+  eyesAsleep = true;
+}
+
+void eyesWake(void) {
+  if(!eyesAsleep) return;
+  displayPower(true); // Panel RAM is retained, so eye[].drawn still holds
+  eyesAsleep = false;
 }
 
 
@@ -618,11 +1417,56 @@ void frame( // Process motion for a single frame of left or right eye
   static uint32_t frames   = 0; // Used in frame rate calculation
   static uint8_t  eyeIndex = 0; // eye[] array counter
   int16_t         eyeX, eyeY;
-  uint32_t        t = micros(); // Time at start of function
+  uint32_t        t; // Time at start of function
+
+  audioService(); // Top up the sound stream while the last eye drains
+  if(soundDoneIdx >= 0) { // Printed here, it'd hold up the DAC interrupt
+    Unsaturated::AudioUnderrunStats xrun = soundStream.underrunStats();
+    soundStream.resetUnderrunStats();
+    Serial.println("Sound Done (idx = " + String(soundDoneIdx) + ")" );
+    Serial.println("  Underruns = " + String(xrun.underruns) + " (" +
+      String(xrun.underrunSamples) + " samples), fewest blocks queued = " +
+      String(xrun.minQueued));
+    soundDoneIdx = -1;
+  }
+#ifdef FAST_BOOT
+  if(soundScanning) soundScanStep(); // Rest of the bank, one clip a frame
+  else if(soundIndexDirty && !sampleIsPlaying) soundIndexSave();
+#endif
+  if(Serial.available()) switch(Serial.read()) { // One-letter commands
+#ifdef PROFILE
+    case 'p': // Cycle counts since the last one
+      profDump();
+      break;
+#endif
+    case 'l': // What's in SOUND_DIR, and what made it into the bank
+      listDirectory(SOUND_DIR, NULL);
+      for(uint8_t c=0; c<soundBank.size(); c++) {
+        Serial.println("Clip " + String(c) + ":");
+        printSound(c);
+      }
+      break;
+  }
+
+  if((millis() - lastTriggerTime) > IDLE_TIMEOUT) { // PIR hasn't tripped
+    eyesSleep();
+    __WFI(); // Nothing to draw; doze until SysTick, TC5 or audio wakes us
+    return;
+  }
+  eyesWake();
+#ifdef PACKED_EYES
+  eyeStyleSet(sampleIsPlaying ? EYE_STYLE_PLAYING : EYE_STYLE_IDLE);
+#endif
+  t = micros();
 
   if(!(++frames & 255)) { // Every 256 frames...
     uint32_t elapsed = (millis() - startTime) / 1000;
     if(elapsed) Serial.println(frames / elapsed); // Print FPS
+#ifdef ARDUINO_ARCH_SAMD
+    Serial.print("DMA stall cycles/frame: "); // Time spent waiting on a
+    Serial.println(dmaStallCycles / 256);     // full ring (tune DMA_LINES)
+    dmaStallCycles = 0;
+#endif
   }
 
   if(++eyeIndex >= NUM_EYES) eyeIndex = 0; // Cycle through eyes, 1 per call
@@ -789,8 +1633,8 @@ void frame( // Process motion for a single frame of left or right eye
           sampleY = SCLERA_HEIGHT / 2 - (eyeY + IRIS_HEIGHT / 4);
   // Eyelid is slightly asymmetrical, so two readings are taken, averaged
   if(sampleY < 0) n = 0;
-  else            n = (upper[sampleY][sampleX] +
-                       upper[sampleY][SCREEN_WIDTH - 1 - sampleX]) / 2;
+  else            n = (UPPER_ROW(sampleY)[sampleX] +
+                       UPPER_ROW(sampleY)[SCREEN_WIDTH - 1 - sampleX]) / 2;
   uThreshold = (uThreshold * 3 + n) / 4; // Filter/soften motion
   // Lower eyelid doesn't track the same way, but seems to be pulled upward
   // by tension from the upper lid.
@@ -823,33 +1667,58 @@ void frame( // Process motion for a single frame of left or right eye
 
 // Autonomous iris motion uses a fractal behavior to similate both the major
 // reaction of the eye plus the continuous smaller adjustments that occur.
-
-uint16_t oldIris = (IRIS_MIN + IRIS_MAX) / 2, newIris;
-
-void split( // Subdivides motion path into two sub-paths w/randimization
-  int16_t  startValue, // Iris scale value (IRIS_MIN to IRIS_MAX) at start
-  int16_t  endValue,   // Iris scale value at end
-  uint32_t startTime,  // micros() at start
-  int32_t  duration,   // Start-to-end time, in microseconds
-  int16_t  range) {    // Allowable scale value variance when subdividing
-
-  if(range >= 8) {     // Limit subdvision count, because recursion
-    range    /= 2;     // Split range & time in half for subdivision,
-    duration /= 2;     // then pick random center point within range:
-    int16_t  midValue = (startValue + endValue - range) / 2 + random(range);
-    uint32_t midTime  = startTime + duration;
-    split(startValue, midValue, startTime, duration, range); // First half
-    split(midValue  , endValue, midTime  , duration, range); // Second half
-  } else {             // No more subdivisons, do iris motion...
-    int32_t dt;        // Time (micros) since start of motion
-    int16_t v;         // Interim value
-    while((dt = (micros() - startTime)) < duration) {
-      v = startValue + (((endValue - startValue) * dt) / duration);
-      if(v < IRIS_MIN)      v = IRIS_MIN; // Clip just in case
-      else if(v > IRIS_MAX) v = IRIS_MAX;
-      frame(v);        // Draw frame w/interim iris scale value
+// Every IRIS_DURATION microseconds irisPlan() picks a new target and
+// subdivides the path there: the midpoint of each piece gets a random
+// offset within a range that halves at every level, down to a range of
+// 8.  The values at the resulting (equally spaced) breakpoints go in
+// irisKey[], and irisValue() interpolates between them for each frame,
+// so loop() never blocks or recurses.
+
+#define IRIS_DURATION 10000000L   // Microseconds from one target to the next
+#define IRIS_LEVELS   7           // Most subdivisions (only for range 1023)
+#define IRIS_KEYS     (1 << IRIS_LEVELS)
+
+int16_t  irisKey[IRIS_KEYS + 1];  // Iris scale at each breakpoint (signed,
+                                  // midpoints can dip below 0)
+uint16_t irisStep;                // Keys from one breakpoint to the next
+uint32_t irisStart,               // micros() at irisKey[0]
+         irisSpan,                // Time between breakpoints
+         irisLength = 0;          // Time to last one (0 = no path yet)
+
+void irisPlan(int16_t startValue, int16_t endValue, uint32_t startTime) {
+  int16_t  range    = IRIS_MAX - IRIS_MIN; // Allowable variance
+  uint32_t duration = IRIS_DURATION;
+  irisKey[0]         = startValue;
+  irisKey[IRIS_KEYS] = endValue;
+  for(irisStep = IRIS_KEYS; (range >= 8) && (irisStep > 1); irisStep /= 2) {
+    range    /= 2; // Split range & time in half for subdivision,
+    duration /= 2; // then pick random center point within range:
+    for(uint16_t k=0; k<IRIS_KEYS; k+=irisStep) {
+      irisKey[k + irisStep / 2] =
+        (irisKey[k] + irisKey[k + irisStep] - range) / 2 + random(range);
     }
   }
+  irisStart  = startTime;
+  irisSpan   = duration;
+  irisLength = duration * (IRIS_KEYS / irisStep);
+}
+
+uint16_t irisValue(uint32_t t) { // Iris scale at micros() time t
+  uint32_t dt = t - irisStart;
+  if(!irisLength) {                          // First call
+    irisPlan((IRIS_MIN + IRIS_MAX) / 2, random(IRIS_MIN, IRIS_MAX), t);
+    dt = 0;
+  } else if(dt >= irisLength) {              // Reached the target
+    irisPlan(irisKey[IRIS_KEYS], random(IRIS_MIN, IRIS_MAX), t);
+    dt = 0;
+  }
+  uint32_t n = dt / irisSpan;                // Breakpoint before t
+  const int16_t *key  = &irisKey[n * irisStep];
+  int16_t  v = key[0] + ((int32_t)(key[irisStep] - key[0]) *
+                         (int32_t)(dt - n * irisSpan)) / (int32_t)irisSpan;
+  if(v < IRIS_MIN)      v = IRIS_MIN;        // Clip just in case
+  else if(v > IRIS_MAX) v = IRIS_MAX;
+  return v;
 }
 
 #endif // !LIGHT_PIN
@@ -881,11 +1750,9 @@ void loop() {
   frame(v);
 #endif // IRIS_SMOOTH
 
-#else  // Autonomous iris scaling -- invoke recursive function
+#else  // Autonomous iris scaling, one frame per pass
 
-  newIris = random(IRIS_MIN, IRIS_MAX);
-  split(oldIris, newIris, micros(), 10000000L, IRIS_MAX - IRIS_MIN);
-  oldIris = newIris;
+  frame(irisValue(micros()));
 
 #endif // LIGHT_PIN
 }
@@ -13,8 +13,10 @@
 
 #include "WavLoader.h"
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <limits>
+#include <atomic>
 
 namespace Unsaturated {
 
@@ -41,65 +43,247 @@ namespace Unsaturated {
 		 BadFile = 1,
 		 BadSampleSize = 2,
 	};
+
+	/* What a sampler's read() has run into since its stats were last
+	 * reset: for sizing BlockSize/NumBlocks against real playback
+	 */
+	struct AudioUnderrunStats
+	{
+		uint32_t underruns;       /* Times read() ran out of loaded blocks */
+		uint32_t underrunSamples; /* Samples it filled in while waiting */
+		uint32_t minQueued;       /* Fewest blocks ready on reaching the ring */
+	};
 	/*
-	 * Simple version 1 non-pitch stretching sampler.
-	 * optimized to play the beginning of the file quickly.
+	 * Formats a sampler can play as SampleType: PCM of that size, or
+	 * mono IMA ADPCM, decoded to 16 bits as it's loaded
 	 */
 	template <typename SampleType>
+		bool canPlay(const WavInfo& info) {
+		if (info.format.audio_format == kIMAADPCMFormat) {
+			return sizeof(SampleType) == sizeof(int16_t) &&
+				info.format.num_channels == 1 &&
+				info.format.block_align <= kMaxIMABlockAlign &&
+				info.samples_per_block;
+		}
+		return info.format.bits_per_sample == sizeof(SampleType) * 8;
+	}
+
+	/*
+	 * Simple version 1 non-pitch stretching sampler (put an
+	 * AudioResampler after it to change rate or pitch),
+	 * optimized to play the beginning of the file quickly.
+	 *
+	 * BlockSize is in bytes.  MaxJawFrames is the longest jaw track
+	 * (see JawTrackHeader) and IntroBlocks the size of the intro buffer
+	 * that load() reads into; a stream that's only ever cue()d from a
+	 * SoundBank can set both to 0.  File block N lives in ring slot
+	 * N % NumBlocks, so finding a block is a single compare no
+	 * matter how many blocks are cached.
+	 *
+	 * The ring is a single-producer / single-consumer queue of blocks:
+	 * prime() is the producer and read() the consumer, and read() may
+	 * preempt prime() at any point (e.g. from a higher priority
+	 * interrupt) without blocking or seeing a half-loaded block.
+	 * Blocks [_tail, _head) are loaded and belong to the consumer;
+	 * the producer only ever loads block _head, and only once its
+	 * slot has been given up (_head < _tail + NumBlocks).  Seeking and
+	 * cue() are consumer side, call them from read()'s context or while
+	 * read() isn't running.
+	 *
+	 * IMA ADPCM clips are decoded by prime() as it loads each block, so
+	 * the ring always holds PCM.  Their ring blocks hold a whole number
+	 * of ADPCM blocks (a little under SamplesPerBlock samples), so every
+	 * ring block starts on one and seeking costs no more than for PCM.
+	 *
+	 * read() only comes up short at the end of the clip (atEOF()).  If
+	 * prime() falls behind, the rest of the read is filled with the last
+	 * sample played and the clip picks up where it left off once the
+	 * block is in, so a slow flash read stretches the sound rather than
+	 * cutting it off.  Each such underrun is counted in underrunStats().
+	 * After a second of nothing read() gives up and returns short, as a
+	 * file that's stopped reading would otherwise hold the note forever;
+	 * setUnderrunHold(false) gives up straight away, for callers that
+	 * prime() on a short read themselves.
+	 *
+	 * With setLooping(true), a clip with loop points (a 'smpl' chunk, see
+	 * BasicWavLoader::hasLoop()) goes back to the loop start each time
+	 * read() reaches the loop end.  To make that wrap as instant as a
+	 * cue(), LoopBlocks blocks' worth from the loop start are kept in RAM
+	 * like the intro: prime() loads them once per clip, when it has
+	 * nothing better to do (the ring's full), and after a wrap read()
+	 * plays them while prime() refills the ring from where they end.
+	 * Until they're in, a wrap is a plain backward seek.
+	 */
+	template <typename SampleType,
+						int BlockSize = 2048,
+						int NumBlocks = 3,
+						int MaxJawFrames = 1024,
+						int IntroBlocks = 2,
+						int LoopBlocks = 0,
+						typename FileType = FileWrapper>
 		class AudioSamplerStream
-		: public AudioInputStream<AudioSamplerStream<SampleType>, SampleType> {
-		using ThisClass = AudioSamplerStream<SampleType>;
+		: public AudioInputStream<AudioSamplerStream<SampleType, BlockSize, NumBlocks, MaxJawFrames, IntroBlocks, LoopBlocks, FileType>, SampleType> {
+		using ThisClass = AudioSamplerStream<SampleType, BlockSize, NumBlocks, MaxJawFrames, IntroBlocks, LoopBlocks, FileType>;
 	
 	public:
-		static constexpr int BlockSize = 2048;
-		static constexpr int NumBlocks = 3;
 		static constexpr int SamplesPerBlock = BlockSize/sizeof(SampleType);
 
-		AudioSamplerStream() : _file(), _introBufSize(0) { }
+		AudioSamplerStream()
+			: _file(), _intro(_introBuf), _introBufSize(0), _info()
+			, _jawTrack(_jaw), _jawFrames(0), _blockSamples(SamplesPerBlock)
+			, _openFile(nullptr), _fileIntroSize(0), _fileBlockSamples(SamplesPerBlock)
+			, _cueFile(nullptr), _cueInfo(), _cueIntroSize(0)
+			, _fileCue(0), _fileLoopStart(0), _fileLoopEnd(0)
+			, _loopBufStart(0), _loopBufSize(0)
+			, _lastSample(), _holdUnderruns(true), _underrunRun(0) {
+			_looping.store(false, std::memory_order_relaxed);
+			_cueCount.store(0, std::memory_order_relaxed);
+			_loopCue.store(~0u, std::memory_order_relaxed);
+			resetUnderrunStats();
+		}
 
 	public:
 
-		unsigned int sample_rate() { return _file.sampleRate(); };
-		unsigned int num_channels() { return _file.numChannels(); };
+		unsigned int sample_rate() { return _info.format.sample_rate; };
+		unsigned int num_channels() { return _info.format.num_channels; };
     unsigned int sample_index() { return _sampleIdx; }
+    bool has_jaw_track() { return _jawFrames != 0; }
+    /* Jaw angle from the clip's jaw track at sample_index(), or -1 if
+     * there's no track (or it's run out)
+     */
+    int jaw_level() {
+      if (!_jawFrames) return -1;
+      uint32_t frame = (uint32_t)((uint64_t)_sampleIdx * _info.jaw_rate /
+                                  _info.format.sample_rate);
+      return (frame < _jawFrames) ? _jawTrack[frame] : -1;
+    }
     bool set_sample_index(uint32_t sampleIndex) { 
-      if (sampleIndex < _file.numSamples()) {
+      if (sampleIndex < _info.length) {
         _sampleIdx = sampleIndex;
+        seekBlocks(sampleIndex);
+        return true;
       }
+      return false;
     }
 		
-		AudioSamplerError load(FileWrapper* file) {
+		AudioSamplerError load(FileType* file) {
 			/* 
 			 * Load the file and fail if the sample format is incompatible
 			 */
 			if(_file.open(file)) {
-				if (_file.bitsPerSample() != sizeof(SampleType) * 8) {
+				if (!canPlay<SampleType>(_file.info())) {
 					return AudioSamplerError::BadSampleSize;
 				}
 
+				_info = _file.info();
+				_blockSamples = _fileBlockSamples = ringBlockSamples(_info);
+				_jawTrack = _jaw;
+				_jawFrames = _file.readJawTrack(_jaw, MaxJawFrames);
+				_intro = _introBuf;
 				loadIntroBuffer();
-				_readHead = _introBuf;
+				_readHead = _intro;
 				_sampleIdx = 0;
-				for (int i = 0; i < NumBlocks; i++) {
-					_bufBlockMap[i] = UnmappedBlock;
-				}
+				_lastSample = SampleType();
+				_underrunRun = 0;
+				_openFile = _cueFile = file;
+				_fileIntroSize = _cueIntroSize = _introBufSize;
+				_cueInfo = _info;
+				_fileCue = _cueCount.load(std::memory_order_relaxed) + 1;
+				_fileLoopStart = _info.loop_start;
+				_fileLoopEnd = _info.loop_end;
+				_cueCount.store(_fileCue, std::memory_order_relaxed);
+				_loopCue.store(_fileCue - 1, std::memory_order_relaxed);
+				_head.store(0, std::memory_order_relaxed);
+				_tail.store(0, std::memory_order_relaxed);
+				_ackGen.store(0, std::memory_order_relaxed);
+				_seekGen.store(0, std::memory_order_release);
 		
 				return AudioSamplerError::NoErr;
 			}
 			return AudioSamplerError::BadFile;
 		}		
+
+		/*
+		 * Switch to another clip and rewind to its start, without touching
+		 * the file: everything the consumer needs (format, intro samples,
+		 * jaw track) is handed in, already in RAM.  read() plays the intro
+		 * straight away; the next prime() reopens the file for the rest.
+		 */
+		void cue(FileType* file, const WavInfo& info,
+						 const SampleType* intro, uint32_t introSamples,
+						 const uint8_t* jaw, uint32_t jawFrames) {
+			_info = info;
+			_intro = intro;
+			_introBufSize = introSamples;
+			_readHead = intro;
+			_jawTrack = jaw;
+			_jawFrames = jawFrames;
+			_blockSamples = ringBlockSamples(info);
+			_sampleIdx = 0;
+			_lastSample = SampleType();
+			_underrunRun = 0;
+
+			/* Producer's copy, picked up along with the new generation */
+			_cueFile = file;
+			_cueInfo = info;
+			_cueIntroSize = introSamples;
+			_cueCount.store(_cueCount.load(std::memory_order_relaxed) + 1,
+											std::memory_order_relaxed);
+			_tail.store(0, std::memory_order_relaxed);
+			_seekGen.store(_seekGen.load(std::memory_order_relaxed) + 1,
+										 std::memory_order_release);
+		}
 		
-		int read(SampleType* buf, unsigned int numSamples) {	  
+		int read(SampleType* buf, unsigned int numSamples) {
+			uint32_t loopEnd = _info.loop_end;
+			if (!loopEnd || _sampleIdx > loopEnd ||
+					!_looping.load(std::memory_order_relaxed)) {
+				return readSpan(buf, numSamples, _info.length);
+			}
+			/* Up to the loop end, back to the loop start and on again, as
+			 * many times round as the read takes
+			 */
+			unsigned int done = 0;
+			while (done < numSamples) {
+				if (_sampleIdx >= loopEnd) loopBack();
+				unsigned int n = readSpan(buf + done, numSamples - done, loopEnd);
+				if (!n) break;
+				done += n;
+			}
+			return done;
+		}
+
+		/* Keep going round the clip's loop (if it has one) or not.  Off,
+		 * the clip plays on past the loop end to the end of the clip.
+		 * Can be changed at any time, read() picks it up on its next call.
+		 */
+		void setLooping(bool looping) {
+			_looping.store(looping, std::memory_order_relaxed);
+		}
+
+	private:
+
+		/* read() as far as sample end at most: the end of the clip, or of
+		 * its loop
+		 */
+		int readSpan(SampleType* buf, unsigned int numSamples, uint32_t end) {
+			/* Stop at the end of the data, the last block read from the
+			 * file may run on into whatever chunk follows it
+			 */
+			if (_sampleIdx >= end) return 0;
+			if (numSamples > end - _sampleIdx) {
+				numSamples = end - _sampleIdx;
+			}
 			unsigned int numSamplesLeft = numSamples;
 
 			/* Make sure the readHead is still good */
 			if (_sampleIdx < _introBufSize) {
-				_readHead = _introBuf + _sampleIdx;
+				_readHead = _intro + _sampleIdx;
 				
 				/* Read from introBuf */
 				unsigned int to_read = numSamples;
-				if ((_readHead + to_read) > (_introBuf + _introBufSize)) {
-					to_read = _introBufSize - (_readHead - _introBuf);
+				if ((_readHead + to_read) > (_intro + _introBufSize)) {
+					to_read = _introBufSize - (_readHead - _intro);
 				}
 				memcpy(buf, _readHead, to_read * sizeof(SampleType));
 				numSamplesLeft -= to_read;
@@ -111,32 +295,52 @@ namespace Unsaturated {
 			/* At this point we have either served the whole read
 			 *  or we have exhausted the introBuf.
 			 */
+
+			/* Then the start of the loop, if it's resident and that's
+			 * where we are
+			 */
+			if (numSamplesLeft > 0 && loopResident() && _sampleIdx >= _loopBufStart &&
+					_sampleIdx < _loopBufStart + _loopBufSize) {
+				unsigned int to_read = _loopBufStart + _loopBufSize - _sampleIdx;
+				if (to_read > numSamplesLeft) to_read = numSamplesLeft;
+				memcpy(buf, _loopBuf + (_sampleIdx - _loopBufStart), to_read * sizeof(SampleType));
+				numSamplesLeft -= to_read;
+				buf += to_read;
+				_sampleIdx += to_read;
+			}
 			
+			/* How far ahead of the reader the ring's got */
+			if (numSamplesLeft > 0 && _blockSamples) {
+				uint32_t queued = blocksQueued();
+				if (queued < _stats.minQueued) _stats.minQueued = queued;
+			}
+
 			/* Read from the cache */
-			while (numSamplesLeft > 0) {
-				int fileBlock = ((_sampleIdx - _introBufSize) / SamplesPerBlock);
-				int fileBlockOffset = ((_sampleIdx - _introBufSize) % SamplesPerBlock);
-				int ringBufBlock = -1;
-				/* Find the new position for the read head */
-				for (int i = 0; i < NumBlocks; i++) {
-					int block = _bufBlockMap[i];
-					if (block == fileBlock) {
-						_readHead = _ringBuf + (i * SamplesPerBlock) + fileBlockOffset;
-						ringBufBlock = i;
-						fileBlock = block;
-						break;
-					}
-				}
+			while (numSamplesLeft > 0 && _blockSamples) {
+				unsigned int fileBlock = ((_sampleIdx - _introBufSize) / _blockSamples);
+				unsigned int fileBlockOffset = ((_sampleIdx - _introBufSize) % _blockSamples);
+				unsigned int ringBufBlock = fileBlock % NumBlocks;
 
-				/* Bail if we didn't have the required block in the cache */
-				if (ringBufBlock == -1) break;
+				/* Bail if we didn't have the required block in the cache,
+				 * or a seek hasn't been picked up by prime() yet
+				 */
+				if (_seekGen.load(std::memory_order_relaxed) !=
+						_ackGen.load(std::memory_order_acquire)) break;
+				if (fileBlock >= _head.load(std::memory_order_acquire)) break;
+
+				/* Done with the blocks before this one, prime() may reuse
+				 * their slots
+				 */
+				if (fileBlock != _tail.load(std::memory_order_relaxed)) {
+					_tail.store(fileBlock, std::memory_order_release);
+				}
 
 				/* Clip the memcpy to the end of this block */
 				unsigned int to_read = numSamplesLeft;
-				SampleType* nextBlockStart = _ringBuf + (ringBufBlock + 1) * SamplesPerBlock;
-				if ( nextBlockStart - _readHead <= to_read ) {
-					to_read = nextBlockStart - _readHead;
+				if (_blockSamples - fileBlockOffset <= to_read) {
+					to_read = _blockSamples - fileBlockOffset;
 				}
+				_readHead = _ringBuf + (ringBufBlock * SamplesPerBlock) + fileBlockOffset;
 				memcpy(buf, _readHead, to_read * sizeof(SampleType));
 				numSamplesLeft -= to_read;
 				_readHead += to_read;
@@ -144,84 +348,152 @@ namespace Unsaturated {
 				_sampleIdx += to_read;
 			}
 
+			/* Ran dry before the end of the clip: hold the last sample
+			 * until prime() catches up, without moving _sampleIdx
+			 */
+			if (numSamplesLeft < numSamples) {
+				_lastSample = buf[-1];
+				_underrunRun = 0;
+			}
+			if (numSamplesLeft > 0 && _holdUnderruns && _blockSamples &&
+					_underrunRun < _info.format.sample_rate) {
+				if (!_underrunRun) _stats.underruns++;
+				for (unsigned int i = 0; i < numSamplesLeft; i++) buf[i] = _lastSample;
+				_stats.underrunSamples += numSamplesLeft;
+				_underrunRun += numSamplesLeft;
+				numSamplesLeft = 0;
+			}
+
 			return numSamples - numSamplesLeft;
 		}
 
+	public:
+
+		/* Hold the last sample through an underrun (the default), or
+		 * return short straight away
+		 */
+		void setUnderrunHold(bool hold) { _holdUnderruns = hold; }
+
+		/* Consumer side counters; reset them from read()'s context or
+		 * while it isn't running
+		 */
+		AudioUnderrunStats underrunStats() { return _stats; }
+		void resetUnderrunStats() {
+			_stats.underruns = _stats.underrunSamples = 0;
+			_stats.minQueued = NumBlocks;
+		}
+
 		/* prime() MUST NOT block the read method, which will be
 		 *	called from a real-time context like an interrupt handler.
+		 *
+		 * Loads at most one block per call and returns true if it did:
+		 * the next one after those already queued, as long as the ring
+		 * has room for it.  With maxBlocks 2 it loads the next two if
+		 * there's room, in one read, for catching up when the ring's
+		 * running low.
+		 *
+		 * cue() and seeks may interrupt prime() at any point.  It copies
+		 * the cue and checks the seek generation again before taking it
+		 * up, and read() won't touch the ring until _ackGen matches, so
+		 * a block loaded for the old clip is never played.
 		 */
-		bool prime() {
-			/* Find any block that could be loaded with a block that is closer
-			 * to the read head and load that
-			 */
+		bool prime(unsigned int maxBlocks = 1) {
+			uint32_t gen  = _seekGen.load(std::memory_order_acquire);
+			uint32_t tail = _tail.load(std::memory_order_acquire);
+			uint32_t head = _head.load(std::memory_order_relaxed);
 
-			long int readHeadBlock = 0;
-	  
-			if (_sampleIdx >= _introBufSize) {
-				readHeadBlock = ((_sampleIdx - _introBufSize) / SamplesPerBlock);
-			}
-	  
-			/* First find the furthest block from the read head */
-			int idx = 0;
-			long maxDiff = labs(_bufBlockMap[0] - readHeadBlock);
-			for (int i = 1; i < NumBlocks; i++) {
-				long thisDiff = labs(_bufBlockMap[i] - readHeadBlock);
-				if (thisDiff > maxDiff) {
-					idx = i;
-					maxDiff = thisDiff;
+			if (gen != _ackGen.load(std::memory_order_relaxed)) {
+				/* Seeked backwards or cued another clip: everything queued
+				 * is stale, start over at the new read position
+				 */
+				FileType* file = _cueFile;
+				WavInfo info = _cueInfo;
+				size_t introSize = _cueIntroSize;
+				uint32_t cue = _cueCount.load(std::memory_order_relaxed);
+				/* cue() again while copying those?  Try again next time */
+				if (gen != _seekGen.load(std::memory_order_acquire)) return false;
+				if (file != _openFile) {
+					if (_openFile) _file.close();
+					_openFile = _file.open(file, info) ? file : nullptr;
 				}
+				_fileIntroSize = introSize;
+				_fileBlockSamples = ringBlockSamples(info);
+				_fileCue = cue;
+				_fileLoopStart = info.loop_start;
+				_fileLoopEnd = info.loop_end;
+				head = tail;
+				_head.store(head, std::memory_order_relaxed);
+				_ackGen.store(gen, std::memory_order_release);
 			}
-     
-			/* Determine if it could be filled with something better */
-			if (maxDiff > 0) {
-        //Serial.println("maxDiff = " + String(maxDiff));
-				for (int absDiff = 0; absDiff < maxDiff; absDiff++) {
-					long int offset = absDiff;
-					/* Look ahead and behind, in that order */
-					for (int sign = 0; sign < 2; offset = -offset, sign++) {
-						long int block = readHeadBlock + offset;
-						if (block < 0) break;
-						if (block * SamplesPerBlock > (_file.numSamples() - _introBufSize)) break;
-						/* Scan the blocks to see if we already have it
-						 *	in the buffer
-						 */
-						for (int i = 0; i < NumBlocks; i++) {
-							if (_bufBlockMap[i] == block) {
-								block = -1;
-								break;
-							}
-						}
-
-						if (block >= 0) {
-							/* We found a block that is closer to the read head.
-							 * Read this block and bail.
-							 */
-              //Serial.println("Reading block " + String(block) + " to [" + String(idx) + "]");
-							if (!_file.seek((block * SamplesPerBlock) + _introBufSize)) {
-								break;
-							}
-              
-							size_t numRead = _file.read(_ringBuf + (idx * SamplesPerBlock),
-																					BlockSize);
-							if(numRead > 0) {
-								_bufBlockMap[idx] = block;
-								return true;
-							}
-							/* Handle a short read here */
-						}
-					}
+			else if (head < tail) {
+				/* Seeked (or played) past what was queued */
+				head = tail;
+				_head.store(head, std::memory_order_release);
+			}
+
+			uint32_t blockSamples = _fileBlockSamples;
+			if (!_openFile || !blockSamples) return false;
+			/* Nothing to load into the ring?  Then the loop start */
+			if (head >= tail + NumBlocks) return loadLoop(); /* Ring is full */
+			if (head * blockSamples >= (_file.numSamples() - _fileIntroSize)) return loadLoop();
+
+			//Serial.println("Reading block " + String(head) + " to [" + String(head % NumBlocks) + "]");
+			/* Straight on from the last block needs no seek */
+			uint32_t sample = (head * blockSamples) + _fileIntroSize;
+			if (_file.position() != sample && !_file.seek(sample)) {
+				return false;
+			}
+
+			bool two = (maxBlocks > 1) && (head + 1 < tail + NumBlocks) &&
+				((head + 1) * blockSamples < (_file.numSamples() - _fileIntroSize));
+			SampleType* slot = _ringBuf + ((head % NumBlocks) * SamplesPerBlock);
+			SampleType* next = _ringBuf + (((head + 1) % NumBlocks) * SamplesPerBlock);
+			uint32_t loaded = 0;
+			if (_file.isIMAADPCM()) {
+				size_t numDecoded = decodeIMABlocks(slot, blockSamples);
+				if (numDecoded > 0) loaded = 1;
+				if (two && numDecoded == blockSamples && decodeIMABlocks(next, blockSamples) > 0) {
+					loaded = 2;
 				}
-		  
 			}
+			else {
+				size_t numRead;
+				if (!two) {
+					numRead = _file.read(slot, BlockSize);
+				}
+				else if (next == slot + SamplesPerBlock) {
+					numRead = _file.read(slot, 2 * BlockSize); /* Side by side */
+				}
+				else {
+					numRead = _file.read(slot, BlockSize, next, BlockSize); /* Wraps */
+				}
+				loaded = (numRead > BlockSize) ? 2 : (numRead > 0) ? 1 : 0;
+			}
+			if (loaded) {
+				/* Publish only once the whole block is in */
+				_head.store(head + loaded, std::memory_order_release);
+				return true;
+			}
+			/* Handle a short read here */
 			return false;
 		}
 
+		/* Blocks loaded and waiting ahead of read(), so the caller can
+		 * tell how urgently prime() needs to run
+		 */
+		unsigned int blocksQueued() {
+			uint32_t tail = _tail.load(std::memory_order_acquire);
+			uint32_t head = _head.load(std::memory_order_acquire);
+			return (head > tail) ? head - tail : 0;
+		}
+
 		bool atEOF() {
-			return _sampleIdx >= _file.numSamples();
+			return _sampleIdx >= _info.length;
 		};
 
 		void setSampleIndex(uint32_t sampleIdx) {
-			_sampleIdx = std::min(sampleIdx, _file.numSamples());
+			_sampleIdx = std::min(sampleIdx, _info.length);
+			seekBlocks(_sampleIdx);
 		}
 
 		uint32_t sampleIndex() { return _sampleIdx; }
@@ -231,8 +503,109 @@ namespace Unsaturated {
 		}
 	
 	private:
+
+		/* Cache block holding a sample (block 0 for the intro buffer) */
+		unsigned int blockForSample(uint32_t sampleIdx) {
+			if (sampleIdx < _introBufSize || !_blockSamples) return 0;
+			return (sampleIdx - _introBufSize) / _blockSamples;
+		}
+
+		/* Consumer side: is _loopBuf loaded, for the clip being read()? */
+		bool loopResident() {
+			return LoopBufCapacity &&
+				_loopCue.load(std::memory_order_acquire) == _cueCount.load(std::memory_order_relaxed);
+		}
+
+		/* Consumer side: wrap from the loop end to the loop start.  If
+		 * the start is resident, the ring is only needed from where it
+		 * ends, so that's where prime() is sent to refill.
+		 */
+		void loopBack() {
+			_sampleIdx = _info.loop_start;
+			uint32_t resume = _sampleIdx;
+			if (loopResident() && _sampleIdx >= _loopBufStart &&
+					_sampleIdx < _loopBufStart + _loopBufSize) {
+				resume = std::min<uint32_t>(_loopBufStart + _loopBufSize, _info.length);
+			}
+			seekBlocks(resume);
+		}
+
+		/* Producer side: fill _loopBuf from the loop start of the clip
+		 * _file has open, once per cue().  Not needed (left empty) for a
+		 * loop that starts inside the intro.  Returns true if it read
+		 * anything.
+		 */
+		bool loadLoop() {
+			if (!LoopBufCapacity || _loopCue.load(std::memory_order_relaxed) == _fileCue) {
+				return false; /* None, or done already */
+			}
+			uint32_t start = _fileLoopStart, size = 0;
+			if (_fileLoopEnd && start >= _fileIntroSize && _file.seek(start)) {
+				start = _file.position(); /* IMA ADPCM: its block's start */
+				uint32_t want = std::min<uint32_t>(LoopBufCapacity, _fileLoopEnd - start);
+				if (_file.isIMAADPCM()) {
+					want = (want / _file.samplesPerBlock()) * _file.samplesPerBlock();
+					size = want ? decodeIMABlocks(_loopBuf, want) : 0;
+				}
+				else {
+					size = _file.read(_loopBuf, want * sizeof(SampleType)) / sizeof(SampleType);
+				}
+			}
+			_loopBufStart = start;
+			_loopBufSize = size;
+			_loopCue.store(_fileCue, std::memory_order_release);
+			return size != 0;
+		}
+
+		/* Samples in each ring block for a clip: all of them for PCM,
+		 * whole ADPCM blocks only for IMA ADPCM (0 if one won't fit)
+		 */
+		static uint32_t ringBlockSamples(const WavInfo& info) {
+			if (info.format.audio_format != kIMAADPCMFormat) return SamplesPerBlock;
+			if (!info.samples_per_block) return 0;
+			return (SamplesPerBlock / info.samples_per_block) * info.samples_per_block;
+		}
+
+		/* Producer side: read and decode ADPCM blocks from the current
+		 * file position into a ring slot, returns the samples decoded
+		 */
+		size_t decodeIMABlocks(SampleType* slot, uint32_t numSamples) {
+			uint16_t blockAlign = _file.frameAlignment();
+			uint32_t decoded = 0;
+			while (decoded < numSamples) {
+				uint32_t numRead = _file.read(_packed, blockAlign);
+				decoded += decodeIMABlock(_packed, numRead,
+																						 reinterpret_cast<int16_t*>(slot) + decoded,
+																						 numSamples - decoded);
+				if (numRead < blockAlign) break; /* End of the data */
+			}
+			return decoded;
+		}
+
+		/* Consumer side of a seek.  Moving forward just gives up the
+		 * blocks being skipped.  Moving back means what's queued ahead
+		 * of the producer's cursor is for the wrong place, so bump the
+		 * seek generation; read() holds off until prime() has seen it
+		 * and restarted the queue at _tail.
+		 */
+		void seekBlocks(uint32_t sampleIdx) {
+			uint32_t block = blockForSample(sampleIdx);
+			uint32_t gen   = _seekGen.load(std::memory_order_relaxed);
+			if (gen == _ackGen.load(std::memory_order_acquire) &&
+					block >= _tail.load(std::memory_order_relaxed)) {
+				_tail.store(block, std::memory_order_release);
+			}
+			else {
+				_tail.store(block, std::memory_order_relaxed);
+				_seekGen.store(gen + 1, std::memory_order_release);
+			}
+		}
 		
 		AudioSamplerError loadIntroBuffer() {
+			if (_file.isIMAADPCM()) {
+				_introBufSize = 0; /* Packed, play it all from the ring */
+				return AudioSamplerError::NoErr;
+			}
 			_file.seek(0); // in samples
 			// Find the offset that will put the rest of the buffer on block
 			// boundaries
@@ -252,6 +625,13 @@ namespace Unsaturated {
       else {
         introBufSize = IntroBufCapacity * sizeof(SampleType);
       }
+			if (introBufSize > IntroBufCapacity * sizeof(SampleType)) {
+				introBufSize = IntroBufCapacity * sizeof(SampleType);
+			}
+			if (!introBufSize) {
+				_introBufSize = 0; /* No intro, all from the ring */
+				return AudioSamplerError::NoErr;
+			}
 			
 			size_t numRead = _file.read(_introBuf, static_cast<uint32_t>(introBufSize));
 			if (numRead > 0) {
@@ -264,27 +644,572 @@ namespace Unsaturated {
 		}
 
 	
-		static constexpr int IntroBufCapacity = (BlockSize * 2) / sizeof(SampleType);
+		static constexpr int IntroBufCapacity = (BlockSize * IntroBlocks) / sizeof(SampleType);
+		static constexpr int LoopBufCapacity = (BlockSize * LoopBlocks) / sizeof(SampleType);
 		static constexpr int CacheBufSize = (BlockSize * NumBlocks) / sizeof(SampleType);
-		static constexpr auto UnmappedBlock = INT_MAX;
 
 		/* Current offset in the buffer */
-		SampleType* _readHead;
+		const SampleType* _readHead;
 
 		/* Position in the file */
 		uint32_t	_sampleIdx;
 
-		WavLoader _file;
+		BasicWavLoader<FileType> _file;
 		
 		/* Uses what I am calling a 'P-Buffer'
 		 * Which is a ring-buffer with a lead-in
 		 *	that optimizes for low-latency sample restarts.
 		 */
+		const SampleType* _intro; /* _introBuf, or a SoundBank's copy */
 		size_t _introBufSize;
-		SampleType	_introBuf[IntroBufCapacity];
+		SampleType	_introBuf[IntroBufCapacity ? IntroBufCapacity : 1];
 		SampleType	_ringBuf [CacheBufSize];
-		unsigned int _bufBlockMap[NumBlocks];
+		WavInfo _info;            /* Clip being read() */
+
+		/* Jaw track, loaded whole so it never touches the file */
+		const uint8_t* _jawTrack;
+		uint8_t  _jaw[MaxJawFrames ? MaxJawFrames : 1];
+		uint32_t _jawFrames;
+		uint32_t _blockSamples;   /* Samples per ring block, this clip */
+
+		/* Producer side: clip _file has open, where its ring blocks
+		 * start and how long they are.  Updated from the _cue* fields on
+		 * a new seek generation.
+		 */
+		FileType* _openFile;
+		size_t _fileIntroSize;
+		uint32_t _fileBlockSamples;
+		uint8_t _packed[kMaxIMABlockAlign]; /* One ADPCM block, undecoded */
+		FileType* _cueFile;
+		WavInfo _cueInfo;
+		size_t _cueIntroSize;
 
+		/* Resident loop start.  _cueCount is bumped by every cue() (and
+		 * load()), and producer side _fileCue is the one _file has open;
+		 * prime() fills _loopBuf with the LoopBufCapacity samples from
+		 * _loopBufStart and stamps it with that cue in _loopCue, so
+		 * read() can tell if it's for the clip it's playing.
+		 */
+		std::atomic<bool> _looping;
+		std::atomic<uint32_t> _cueCount;
+		std::atomic<uint32_t> _loopCue;
+		uint32_t _fileCue;
+		uint32_t _fileLoopStart, _fileLoopEnd;
+		uint32_t _loopBufStart, _loopBufSize;
+		SampleType _loopBuf[LoopBufCapacity ? LoopBufCapacity : 1];
+
+		/* Producer/consumer indices (file block numbers), only ever
+		 * loaded & stored -- no read-modify-write on the M0
+		 */
+		std::atomic<uint32_t> _head;    /* Next block prime() loads */
+		std::atomic<uint32_t> _tail;    /* Block read() is playing */
+		std::atomic<uint32_t> _seekGen; /* Bumped by a backward seek */
+		std::atomic<uint32_t> _ackGen;  /* Last one prime() caught up to */
+
+		/* Underruns, consumer side */
+		SampleType _lastSample;   /* Held while the ring's dry */
+		bool _holdUnderruns;
+		uint32_t _underrunRun;    /* Samples held since the last real one */
+		AudioUnderrunStats _stats;
+
+	};
+
+	/*
+	 * A set of clips that can each be started instantly.  add() walks a
+	 * clip's chunks once, keeps its WavInfo, the first IntroBytes of its
+	 * samples and its jaw track (out of a shared JawPoolBytes) in RAM,
+	 * and closes it again; cue() hands all that to a stream, which plays
+	 * the intro while prime() reopens the file for the rest.  Budget is
+	 * about MaxClips * IntroBytes + JawPoolBytes of RAM.
+	 */
+	template <typename SampleType,
+						int MaxClips,
+						int IntroBytes,
+						int JawPoolBytes,
+						typename FileType = FileWrapper>
+		class SoundBank {
+	public:
+		SoundBank() : _numClips(0), _jawUsed(0), _nextClip(0) { }
+
+		/* Returns false if the bank's full or the file isn't usable */
+		bool add(FileType* file) { return add(file, NULL); }
+
+		/* Same, for a file whose info was saved from an earlier add() (and
+		 * is known to be unchanged since): skips parsing the header
+		 */
+		bool add(FileType* file, const WavInfo& info) { return add(file, &info); }
+
+		/* Clips can be added while others play: a clip only counts towards
+		 * size() once it's complete
+		 */
+		unsigned int size() const { return _numClips.load(std::memory_order_acquire); }
+		const WavInfo& info(unsigned int clip) const { return _clips[clip].info; }
+		FileType* file(unsigned int clip) const { return _clips[clip].file; }
+
+		/* Round-robin through the clips */
+		unsigned int nextClip() {
+			unsigned int clip = _nextClip;
+			if (++_nextClip >= size()) _nextClip = 0;
+			return clip;
+		}
+
+		template <typename StreamType>
+		void cue(StreamType& stream, unsigned int clip) {
+			const Clip& c = _clips[clip];
+			stream.cue(c.file, c.info, c.intro, c.introSamples, c.jaw, c.jawFrames);
+		}
+
+	private:
+		static constexpr unsigned int SectorSize = 512;
+		static constexpr uint32_t IntroSamples = IntroBytes / sizeof(SampleType);
+
+		bool add(FileType* file, const WavInfo* known) {
+			unsigned int n = _numClips.load(std::memory_order_relaxed);
+			if (n >= MaxClips) return false;
+
+			BasicWavLoader<FileType> wav;
+			if (!(known ? wav.open(file, *known) : wav.open(file))) return false;
+			if (!canPlay<SampleType>(wav.info()) || !wav.numSamples()) {
+				wav.close();
+				return false;
+			}
+
+			Clip& clip = _clips[n];
+			clip.file = file;
+			clip.info = wav.info();
+
+			if (wav.isIMAADPCM()) {
+				clip.introSamples = decodeIntro(wav, clip.intro);
+			}
+			else {
+				clip.introSamples = readIntro(wav, clip.intro);
+			}
+
+			clip.jaw = _jawPool + _jawUsed;
+			clip.jawFrames = (_jawUsed < JawPoolBytes) ?
+				wav.readJawTrack(_jawPool + _jawUsed, JawPoolBytes - _jawUsed) : 0;
+			_jawUsed += clip.jawFrames;
+
+			wav.close();
+			_numClips.store(n + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* PCM: end the intro on a sector boundary in the file if there's
+		 * room, so the stream's block reads after it stay aligned
+		 */
+		static uint32_t readIntro(BasicWavLoader<FileType>& wav, SampleType* intro) {
+			uint32_t start = wav.filePositionForSample(0);
+			uint32_t dataBytes = wav.numSamples() * sizeof(SampleType);
+			uint32_t introBytes = IntroBytes;
+			if (introBytes >= dataBytes) {
+				introBytes = dataBytes; /* Whole clip fits */
+			}
+			else if (introBytes > (start + introBytes) % SectorSize) {
+				introBytes -= (start + introBytes) % SectorSize;
+			}
+			introBytes -= introBytes % sizeof(SampleType);
+			wav.seek(0);
+			return wav.read(intro, introBytes) / sizeof(SampleType);
+		}
+
+		/* IMA ADPCM: decode as many whole blocks as fit, so the stream's
+		 * ring picks up on a block boundary
+		 */
+		static uint32_t decodeIntro(BasicWavLoader<FileType>& wav, SampleType* intro) {
+			uint32_t want = wav.numSamples();
+			if (want > IntroSamples) {
+				want = (IntroSamples / wav.samplesPerBlock()) * wav.samplesPerBlock();
+			}
+			uint8_t packed[kMaxIMABlockAlign];
+			uint16_t blockAlign = wav.frameAlignment();
+			uint32_t decoded = 0;
+			wav.seek(0);
+			while (decoded < want) {
+				uint32_t numRead = wav.read(packed, blockAlign);
+				decoded += decodeIMABlock(packed, numRead,
+																						 reinterpret_cast<int16_t*>(intro) + decoded,
+																						 want - decoded);
+				if (numRead < blockAlign) break;
+			}
+			return decoded;
+		}
+
+		struct Clip {
+			FileType* file;
+			WavInfo info;
+			SampleType intro[IntroSamples];
+			uint32_t introSamples;
+			const uint8_t* jaw;
+			uint32_t jawFrames;
+		};
+
+		Clip _clips[MaxClips];
+		std::atomic<unsigned int> _numClips;
+		uint8_t _jawPool[JawPoolBytes ? JawPoolBytes : 1];
+		unsigned int _jawUsed;
+		unsigned int _nextClip;
+	};
+
+	/*
+	 * Sums several streams into one, e.g. an ambient loop under a
+	 * triggered laugh.  Voices are pulled MaxBlock samples at a time,
+	 * scaled by their gains and added with saturation, all in fixed
+	 * point and without allocating.  Gains are 16.16 fixed point
+	 * (UnityGain is 1.0) and can ramp linearly to a new value over a
+	 * number of samples, for fades and crossfades.  read() returns as
+	 * many samples as the longest-running voice produced, zero padded.
+	 */
+	template <typename VoiceType,
+						int NumVoices,
+						typename SampleType = int16_t,
+						int MaxBlock = 256>
+		class AudioMixer
+		: public AudioInputStream<AudioMixer<VoiceType, NumVoices, SampleType, MaxBlock>, SampleType> {
+	public:
+		static constexpr int32_t UnityGain = 1L << 16;
+
+		AudioMixer() {
+			for (int i = 0; i < NumVoices; i++) {
+				_voice[i] = nullptr;
+				_gain[i] = UnityGain;
+				_target[i] = UnityGain;
+				_step[i] = 0;
+				_rampLeft[i] = 0;
+			}
+		}
+
+		void setVoice(int voice, VoiceType* stream) { _voice[voice] = stream; }
+		VoiceType* voice(int voice) { return _voice[voice]; }
+
+		/* Move a voice's gain to the given value, over rampSamples
+		 * samples (0 for right away)
+		 */
+		void setGain(int voice, int32_t gain, uint32_t rampSamples = 0) {
+			if (!rampSamples) {
+				_gain[voice] = gain;
+				_rampLeft[voice] = 0;
+			}
+			else {
+				_step[voice] = (gain - _gain[voice]) / (int32_t)rampSamples;
+				_rampLeft[voice] = rampSamples;
+				_target[voice] = gain;
+			}
+		}
+		int32_t gain(int voice) { return _gain[voice]; }
+
+		/* Fade one voice out while another fades in */
+		void crossfade(int from, int to, uint32_t rampSamples) {
+			setGain(from, 0, rampSamples);
+			setGain(to, UnityGain, rampSamples);
+		}
+
+		int read(SampleType* buf, unsigned int numSamples) {
+			unsigned int produced = 0;
+			while (numSamples) {
+				unsigned int n = (numSamples < MaxBlock) ? numSamples : MaxBlock;
+				unsigned int longest = 0;
+				memset(_mixBuf, 0, n * sizeof(_mixBuf[0]));
+				for (int v = 0; v < NumVoices; v++) {
+					if (_voice[v]) {
+						int got = _voice[v]->read(_voiceBuf, n);
+						if (got <= 0) continue;
+						if ((unsigned int)got > longest) longest = got;
+						mixVoice(v, got);
+					}
+				}
+				for (unsigned int i = 0; i < longest; i++) {
+					buf[i] = saturate(_mixBuf[i]);
+				}
+				produced += longest;
+				if (longest < n) {
+					break; /* Every voice has run dry */
+				}
+				buf += n;
+				numSamples -= n;
+			}
+			return produced;
+		}
+
+	private:
+		/* Add _voiceBuf, scaled by the voice's (possibly ramping) gain,
+		 * into _mixBuf
+		 */
+		void mixVoice(int v, unsigned int n) {
+			int32_t g = _gain[v];
+			unsigned int i = 0;
+			/* Ramping part, gain changes every sample */
+			for (; i < n && _rampLeft[v]; i++, _rampLeft[v]--) {
+				g += _step[v];
+				_mixBuf[i] += ((int32_t)_voiceBuf[i] * (g >> 4)) >> 12;
+			}
+			if (i && !_rampLeft[v]) {
+				g = _target[v]; /* Land exactly on it, no rounding creep */
+			}
+			_gain[v] = g;
+			/* Steady part */
+			if (g == UnityGain) {
+				for (; i < n; i++) _mixBuf[i] += _voiceBuf[i];
+			}
+			else if (g) {
+				int32_t g12 = g >> 4;
+				for (; i < n; i++) _mixBuf[i] += ((int32_t)_voiceBuf[i] * g12) >> 12;
+			}
+		}
+
+		static SampleType saturate(int32_t v) {
+			if (v > std::numeric_limits<SampleType>::max()) return std::numeric_limits<SampleType>::max();
+			if (v < std::numeric_limits<SampleType>::min()) return std::numeric_limits<SampleType>::min();
+			return (SampleType)v;
+		}
+
+		VoiceType* _voice[NumVoices];
+		int32_t _gain[NumVoices];     /* 16.16 */
+		int32_t _target[NumVoices];
+		int32_t _step[NumVoices];     /* Per sample while ramping */
+		uint32_t _rampLeft[NumVoices];
+		SampleType _voiceBuf[MaxBlock];
+		int32_t _mixBuf[MaxBlock];
+	};
+
+	/*
+	 * Catmull-Rom interpolation weights for AudioResampler's 4-tap
+	 * filter, one row per 1/64 of a sample, 2.14 fixed point.  Each row
+	 * sums to 1.0.
+	 */
+	static const int16_t ResamplerCubicPhases[64][4] = {
+		{      0,  16384,      0,      0 },
+		{   -124,  16374,    136,     -2 },
+		{   -240,  16345,    287,     -8 },
+		{   -349,  16297,    453,    -17 },
+		{   -450,  16230,    634,    -30 },
+		{   -544,  16146,    828,    -46 },
+		{   -631,  16044,   1036,    -65 },
+		{   -711,  15926,   1256,    -87 },
+		{   -784,  15792,   1488,   -112 },
+		{   -851,  15642,   1732,   -139 },
+		{   -911,  15478,   1986,   -169 },
+		{   -966,  15299,   2251,   -200 },
+		{  -1014,  15106,   2526,   -234 },
+		{  -1057,  14900,   2810,   -269 },
+		{  -1094,  14681,   3103,   -306 },
+		{  -1125,  14450,   3404,   -345 },
+		{  -1152,  14208,   3712,   -384 },
+		{  -1174,  13955,   4027,   -424 },
+		{  -1190,  13691,   4349,   -466 },
+		{  -1202,  13417,   4677,   -508 },
+		{  -1210,  13134,   5010,   -550 },
+		{  -1213,  12842,   5348,   -593 },
+		{  -1213,  12542,   5690,   -635 },
+		{  -1208,  12235,   6035,   -678 },
+		{  -1200,  11920,   6384,   -720 },
+		{  -1188,  11599,   6735,   -762 },
+		{  -1173,  11272,   7088,   -803 },
+		{  -1155,  10939,   7443,   -843 },
+		{  -1134,  10602,   7798,   -882 },
+		{  -1110,  10260,   8154,   -920 },
+		{  -1084,   9915,   8509,   -956 },
+		{  -1055,   9567,   8863,   -991 },
+		{  -1024,   9216,   9216,  -1024 },
+		{   -991,   8863,   9567,  -1055 },
+		{   -956,   8509,   9915,  -1084 },
+		{   -920,   8154,  10260,  -1110 },
+		{   -882,   7798,  10602,  -1134 },
+		{   -843,   7443,  10939,  -1155 },
+		{   -803,   7088,  11272,  -1173 },
+		{   -762,   6735,  11599,  -1188 },
+		{   -720,   6384,  11920,  -1200 },
+		{   -678,   6035,  12235,  -1208 },
+		{   -635,   5690,  12542,  -1213 },
+		{   -593,   5348,  12842,  -1213 },
+		{   -550,   5010,  13134,  -1210 },
+		{   -508,   4677,  13417,  -1202 },
+		{   -466,   4349,  13691,  -1190 },
+		{   -424,   4027,  13955,  -1174 },
+		{   -384,   3712,  14208,  -1152 },
+		{   -345,   3404,  14450,  -1125 },
+		{   -306,   3103,  14681,  -1094 },
+		{   -269,   2810,  14900,  -1057 },
+		{   -234,   2526,  15106,  -1014 },
+		{   -200,   2251,  15299,   -966 },
+		{   -169,   1986,  15478,   -911 },
+		{   -139,   1732,  15642,   -851 },
+		{   -112,   1488,  15792,   -784 },
+		{    -87,   1256,  15926,   -711 },
+		{    -65,   1036,  16044,   -631 },
+		{    -46,    828,  16146,   -544 },
+		{    -30,    634,  16230,   -450 },
+		{    -17,    453,  16297,   -349 },
+		{     -8,    287,  16345,   -240 },
+		{     -2,    136,  16374,   -124 }
+	};
+
+	/*
+	 * Plays a source stream back at a different rate: step is how many
+	 * source samples to advance per output sample, 16.16 fixed point.
+	 * setRates() works it out from the clip's rate, the DAC's rate and a
+	 * pitch factor, so clips recorded at 8, 11.025, 16 or 44.1 kHz all
+	 * play at the sample rate the timer was set up for, and a pitch
+	 * below UnityPitch plays a voice lower (and slower).
+	 *
+	 * Taps is 2 for linear interpolation or 4 for a polyphase cubic
+	 * (ResamplerCubicPhases), which costs about twice as much per
+	 * sample but doesn't dull the highs as badly.  Neither filters out
+	 * what's above the output rate's Nyquist when playing a clip faster,
+	 * so keep clips at or below the DAC rate.  The source is pulled
+	 * MaxBlock samples at a time into a member buffer.
+	 */
+	template <typename SourceType,
+						typename SampleType = int16_t,
+						int Taps = 2,
+						int MaxBlock = 256>
+		class AudioResampler
+		: public AudioInputStream<AudioResampler<SourceType, SampleType, Taps, MaxBlock>, SampleType> {
+		static_assert(Taps == 2 || Taps == 4, "AudioResampler does 2 or 4 taps");
+	public:
+		static constexpr uint32_t UnityPitch = 1UL << 16;
+
+		AudioResampler(SourceType* source = nullptr)
+			: _source(source), _step(1UL << 16) { reset(); }
+
+		void setSource(SourceType* source) { _source = source; reset(); }
+
+		/* pitch is 16.16, UnityPitch plays the clip as recorded */
+		void setRates(uint32_t sourceRate, uint32_t outputRate, uint32_t pitch = UnityPitch) {
+			if (!sourceRate || !outputRate) {
+				sourceRate = outputRate = 1;
+			}
+			_step = (uint32_t)((((uint64_t)sourceRate * pitch) / outputRate));
+			if (!_step) _step = 1;
+		}
+		uint32_t step() { return _step; }
+
+		/* Forget the last clip, call after cueing a new one on the source */
+		void reset() {
+			for (int i = 0; i < Taps; i++) _window[i] = 0;
+			_phase = 0;
+			_srcPos = _srcLen = 0;
+			_primed = false;
+			_ended = false;
+		}
+
+		/* Returns fewer than numSamples only on the call that runs out of
+		 * source, and 0 from then on until reset()
+		 */
+		int read(SampleType* buf, unsigned int numSamples) {
+			if (_ended) return 0;
+			if (!_primed) {
+				/* Fill the window up to the first sample, which lands in
+				 * the tap just before the interpolation point
+				 */
+				_primed = true;
+				for (int i = Taps / 2 - 1; i < Taps; i++) {
+					if (!shiftIn()) return 0;
+				}
+			}
+			unsigned int i = 0;
+			for (; i < numSamples; i++) {
+				buf[i] = interpolate();
+				_phase += _step;
+				while (_phase >= (1UL << 16)) {
+					_phase -= (1UL << 16);
+					if (!shiftIn()) {
+						return i + 1;
+					}
+				}
+			}
+			return i;
+		}
+
+	private:
+		/* Slide the window along one source sample, false once the
+		 * source has run dry
+		 */
+		bool shiftIn() {
+			if (_srcPos >= _srcLen) {
+				int n = (_ended || !_source) ? 0 : _source->read(_srcBuf, MaxBlock);
+				if (n <= 0) {
+					_ended = true;
+					return false;
+				}
+				_srcLen = n;
+				_srcPos = 0;
+			}
+			for (int i = 0; i < Taps - 1; i++) _window[i] = _window[i + 1];
+			_window[Taps - 1] = _srcBuf[_srcPos++];
+			return true;
+		}
+
+		SampleType interpolate() {
+			int32_t v;
+			if (Taps == 2) {
+				/* Halve the fraction so the product can't overflow */
+				int32_t frac = _phase >> 1;
+				v = _window[0] + (((_window[1] - _window[0]) * frac) >> 15);
+			}
+			else {
+				const int16_t* c = ResamplerCubicPhases[_phase >> 10];
+				v = (c[0] * _window[0] + c[1] * _window[1] +
+						 c[2] * _window[Taps > 2 ? 2 : 0] + c[3] * _window[Taps > 3 ? 3 : 0]) >> 14;
+			}
+			if (v > std::numeric_limits<SampleType>::max()) return std::numeric_limits<SampleType>::max();
+			if (v < std::numeric_limits<SampleType>::min()) return std::numeric_limits<SampleType>::min();
+			return (SampleType)v;
+		}
+
+		SourceType* _source;
+		uint32_t _step;      /* 16.16 source samples per output sample */
+		uint32_t _phase;     /* 0.16, from _window[Taps/2 - 1] */
+		int32_t _window[Taps];
+		SampleType _srcBuf[MaxBlock];
+		unsigned int _srcPos;
+		unsigned int _srcLen;
+		bool _primed;
+		bool _ended;
+	};
+
+	/*
+	 * One-pole mean-square envelope follower.  Feed it each block of
+	 * samples as it's produced; the level rises towards the block's
+	 * mean square by 1/2^attackShift of the difference per block and
+	 * falls by 1/2^releaseShift, so reading it is free at any time.
+	 */
+	class EnvelopeFollower {
+	public:
+		EnvelopeFollower(uint8_t attackShift = 1, uint8_t releaseShift = 3)
+			: _attackShift(attackShift), _releaseShift(releaseShift), _level(0) { }
+
+		template <typename SampleType>
+		void add(const SampleType* buf, unsigned int numSamples) {
+			if (!numSamples) return;
+			uint64_t sum = 0;
+			for (unsigned int i = 0; i < numSamples; i++) {
+				int32_t val = buf[i];
+				sum += (uint32_t)(val * val);
+			}
+			update((uint32_t)(sum / numSamples));
+		}
+
+		void update(uint32_t meanSquare) {
+			uint32_t level = _level;
+			if (meanSquare > level) {
+				level += (meanSquare - level) >> _attackShift;
+			}
+			else {
+				level -= (level - meanSquare) >> _releaseShift;
+			}
+			_level = level;
+		}
+
+		/* Smoothed mean square, in squared sample units */
+		uint32_t level() const { return _level; }
+
+		void reset() { _level = 0; }
+
+	private:
+		uint8_t _attackShift;
+		uint8_t _releaseShift;
+		volatile uint32_t _level;
 	};
 											  
 } // namespace Unsaturated
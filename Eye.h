@@ -1 +1,303 @@
+// Eye rendering kernel: everything that turns the eye graphics into
+// pixels, with no knowledge of the display, SPI or DMA.  The sketch feeds
+// its lines to the screen, tools/bench.cpp times it on a host.  Include
+// once, after the eye graphics (i.e. after config.h).
 
+#ifndef _EYE_H_
+#define _EYE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The renderer reads eye graphics only through these, so it works the same
+// on one plain eye header or on a set of packed eyes (graphics/packedEye.h)
+// with eyeStyle pointing at the one being drawn.  SCLERA_ROW() pixels as
+// stored go through SCLERA_COLOR() to become RGB565.  IRIS_FLASH() and
+// POLAR_FLASH() are the iris & polar tables where they're stored; with
+// EYE_RAM_TABLES, IRIS_COLOR() and POLAR_ROW() read the RAM copies
+// eyeRamInit() made of them instead, if it could (see below).
+#ifdef PACKED_EYES
+  const packedEye *eyeStyle = &packedEyes[EYE_STYLE_IDLE];
+  typedef uint8_t scleraPixel;
+  #define SCLERA_ROW(y)   (&eyeStyle->scleraPixels[ \
+                            eyeStyle->scleraRows[y] * SCLERA_WIDTH])
+  #define SCLERA_COLOR(s) (eyeStyle->scleraPalette[s])
+  #define IRIS_FLASH(i)   (eyeStyle->irisPalette[eyeStyle->irisPixels[i]])
+  #define POLAR_FLASH(y)  (&eyeStyle->polar[(y) * IRIS_WIDTH])
+  #define UPPER_ROW(y)    (&eyeStyle->upper[(y) * SCREEN_WIDTH])
+  #define LOWER_ROW(y)    (&eyeStyle->lower[(y) * SCREEN_WIDTH])
+#else
+  typedef uint16_t scleraPixel;
+  #define SCLERA_ROW(y)   (sclera[y])
+  #define SCLERA_COLOR(s) (s)
+  #define IRIS_FLASH(i)   (((const uint16_t *)iris)[i])
+  #define POLAR_FLASH(y)  (polar[y])
+  #define UPPER_ROW(y)    (upper[y])
+  #define LOWER_ROW(y)    (lower[y])
+#endif
+
+#ifdef EYE_RAM_TABLES
+  uint16_t *irisRAM  = NULL, // RGB565 iris map, or NULL if still in flash
+           *polarRAM = NULL; // polar[] rows, or NULL if still in flash
+  #define IRIS_COLOR(i)   (irisRAM ? irisRAM[i] : IRIS_FLASH(i))
+  #define POLAR_ROW(y)    (polarRAM ? &polarRAM[(y) * IRIS_WIDTH] : \
+                                      POLAR_FLASH(y))
+#else
+  #define IRIS_COLOR(i)   IRIS_FLASH(i)
+  #define POLAR_ROW(y)    POLAR_FLASH(y)
+#endif
+
+
+// RAM TABLES --------------------------------------------------------------
+
+// Every pixel inside the iris square reads one polar[] value and one iris
+// map pixel.  polar[] is read straight along each row, which the flash's
+// prefetch keeps up with, but the iris reads jump all over the map with
+// the angle and the iris scale, and each one that misses the flash cache
+// waits on it.  Boards with the RAM to spare (EYE_RAM_TABLES in config.h,
+// a byte budget) get copies: the iris map first, RGB565 even from a packed
+// eye's palette, then polar[] if there's still room.  The sclera is far
+// too big, and read in order anyway, so it stays in flash.  Run after
+// lidInit(), for the same eye.
+void eyeRamInit(void) {
+#ifdef EYE_RAM_TABLES
+  uint32_t irisPixels = (uint32_t)IRIS_MAP_WIDTH * IRIS_MAP_HEIGHT,
+           polarBytes = (uint32_t)IRIS_WIDTH * IRIS_HEIGHT * sizeof(uint16_t),
+           budget     = EYE_RAM_TABLES;
+  uint16_t *p;
+  free(irisRAM);  irisRAM  = NULL; // Last eye's copies, if any
+  free(polarRAM); polarRAM = NULL;
+  if((irisPixels * sizeof(uint16_t) <= budget) &&
+     (p = (uint16_t *)malloc(irisPixels * sizeof(uint16_t)))) {
+    for(uint32_t i=0; i<irisPixels; i++) p[i] = IRIS_FLASH(i);
+    irisRAM = p;
+    budget -= irisPixels * sizeof(uint16_t);
+  }
+  if((polarBytes <= budget) && (p = (uint16_t *)malloc(polarBytes))) {
+    memcpy(p, POLAR_FLASH(0), polarBytes);
+    polarRAM = p;
+  }
+#endif
+}
+
+
+// EYELID SPANS ------------------------------------------------------------
+
+// For a given threshold, each row of the upper[] and lower[] lid maps is
+// (nearly always) open over one run of pixels -- lid values rise toward
+// the middle of the row and fall off again.  lidInit() finds the peak of
+// every row and checks that it really does rise-then-fall; lidSpans() then
+// finds the open run for the current thresholds with a binary search on
+// either side of the peak, so eyeLines() can fill the covered ends of each
+// line black without testing each pixel.  Rows that aren't so well-behaved
+// get the run's outer bounds, are checked for lid pixels inside it, and
+// keep the per-pixel test only if some are found.  (A table of runs for
+// every possible threshold would need 64K per map.)  The row shapes are
+// shared; the runs, like the iris rows below, go in an eyeTables so that
+// screens being drawn at the same time can each have their own.
+
+#define LID_UPPER_OK 1 // upper[] row is rise-then-fall, open run is exact
+#define LID_LOWER_OK 2 // lower[] row is rise-then-fall, open run is exact
+#define LID_EXACT    (LID_UPPER_OK | LID_LOWER_OK)
+
+uint8_t lidPeak[2][SCREEN_HEIGHT], // X of max value in upper/lower rows
+        lidShape[SCREEN_HEIGHT];   // LID_UPPER_OK/LID_LOWER_OK per row
+
+typedef struct {                   // Per-frame tables, see eyeLines():
+  uint8_t  spanX0[SCREEN_HEIGHT],  // Open run of each line is [X0, X1),
+           spanX1[SCREEN_HEIGHT],  // pixels outside this are eyelid
+           spanHoles[SCREEN_HEIGHT], // Nonzero if lid also covers some inside
+           spanUT,                 // Thresholds the runs were found for
+           spanLT;                 // (255 = fully closed, all runs empty)
+  uint16_t irisRow[128];           // Offset in iris[] for each polar distance
+  uint32_t irisRowScale;           // iScale the offsets were found for
+} eyeTables;
+
+// Locate peak of one lid map row, return true if row rises then falls
+static bool lidRowInit(const uint8_t *row, uint8_t *peak) {
+  uint8_t x, p = 0;
+  for(x=1; x<SCREEN_WIDTH; x++) if(row[x] > row[p]) p = x;
+  *peak = p;
+  for(x=0; x<p; x++)              if(row[x] > row[x + 1]) return false;
+  for(x=p; x<SCREEN_WIDTH-1; x++) if(row[x] < row[x + 1]) return false;
+  return true;
+}
+
+void lidInit(void) {
+  for(uint8_t y=0; y<SCREEN_HEIGHT; y++) {
+    lidShape[y] = (lidRowInit(UPPER_ROW(y), &lidPeak[0][y]) ? LID_UPPER_OK : 0) |
+                  (lidRowInit(LOWER_ROW(y), &lidPeak[1][y]) ? LID_LOWER_OK : 0);
+  }
+}
+
+// Mark an eyeTables as holding nothing yet.  Needed before first use, and
+// again whenever lidInit() is run for different maps.
+void eyeTablesInit(eyeTables *t) {
+  memset(t->spanX0,    0, sizeof t->spanX0); // Empty runs, as spanUT/LT
+  memset(t->spanX1,    0, sizeof t->spanX1);
+  memset(t->spanHoles, 0, sizeof t->spanHoles);
+  t->spanUT       = t->spanLT = 255;
+  t->irisRowScale = 0;
+}
+
+// Find run [x0, x1) of one lid map row where values exceed threshold t
+static void lidRowSpan(const uint8_t *row, uint8_t peak, bool exact,
+  uint8_t t, uint8_t *x0, uint8_t *x1) {
+  uint8_t lo, hi, mid;
+  if(row[peak] <= t) {       // Entire row covered
+    *x0 = *x1 = 0;
+  } else if(exact) {         // Binary search up and down the slopes
+    for(lo=0, hi=peak; lo<hi; ) { // First x with row[x] > t
+      mid = (lo + hi) / 2;
+      if(row[mid] > t) hi = mid;
+      else             lo = mid + 1;
+    }
+    *x0 = lo;
+    for(lo=peak+1, hi=SCREEN_WIDTH; lo<hi; ) { // Next x with row[x] <= t
+      mid = (lo + hi) / 2;
+      if(row[mid] <= t) hi = mid;
+      else              lo = mid + 1;
+    }
+    *x1 = lo;
+  } else {                   // Scan in from either end
+    for(lo=0; row[lo] <= t; lo++);
+    for(hi=SCREEN_WIDTH; row[hi - 1] <= t; hi--);
+    *x0 = lo;
+    *x1 = hi;
+  }
+}
+
+// Bring t's spanX0[]/spanX1[] up to date for lid thresholds uT/lT.  If
+// y0/y1 are passed, the band they describe is widened to include every
+// line whose pixels may differ from the previous thresholds' runs.
+void lidSpans(eyeTables *t, uint8_t uT, uint8_t lT,
+  uint8_t *y0, uint8_t *y1) {
+  if((uT == t->spanUT) && (lT == t->spanLT)) return; // Already current
+
+  for(uint8_t y=0; y<SCREEN_HEIGHT; y++) {
+    uint8_t ux0, ux1, lx0, lx1, x, holes = 0, shape = lidShape[y];
+    const uint8_t *uRow = UPPER_ROW(y), *lRow = LOWER_ROW(y);
+    lidRowSpan(uRow, lidPeak[0][y], shape & LID_UPPER_OK, uT, &ux0, &ux1);
+    lidRowSpan(lRow, lidPeak[1][y], shape & LID_LOWER_OK, lT, &lx0, &lx1);
+    if(lx0 > ux0) ux0 = lx0; // Open where both lids are open
+    if(lx1 < ux1) ux1 = lx1;
+    if(ux0 >= ux1) ux0 = ux1 = 0;
+    if(shape != LID_EXACT) { // Run is only the outer bounds, check inside
+      for(x=ux0; (x<ux1) && (uRow[x] > uT) && (lRow[x] > lT); x++);
+      holes = (x < ux1);
+    }
+    if(y0 && ((ux0 != t->spanX0[y]) || (ux1 != t->spanX1[y]) ||
+              holes || t->spanHoles[y])) {
+      if(y <  *y0) *y0 = y;
+      if(y >= *y1) *y1 = y + 1;
+    }
+    t->spanX0[y]    = ux0;
+    t->spanX1[y]    = ux1;
+    t->spanHoles[y] = holes;
+  }
+  t->spanUT = uT;
+  t->spanLT = lT;
+}
+
+
+// IRIS ROWS ---------------------------------------------------------------
+
+// polar[] values are a 7-bit distance and 9-bit angle.  The distance is
+// scaled by iScale to pick an iris[] row, which is the same for every
+// pixel in a frame, so irisRows() works out all 128 of them up front:
+// t->irisRow[] holds the offset of each distance's row in iris[], or
+// IRIS_NONE if it's beyond the iris edge.  The angle scale is a constant
+// multiply & shift (or just a shift for 256/512-wide maps), no table.
+#define IRIS_NONE 0xFFFF
+
+void irisRows(eyeTables *t, uint32_t iScale) {
+  if(iScale == t->irisRowScale) return; // Already current
+  for(uint8_t i=0; i<128; i++) {
+    uint32_t d = (iScale * i) / 128;                  // Distance (Y)
+    t->irisRow[i] = (d < IRIS_MAP_HEIGHT) ? d * IRIS_MAP_WIDTH : IRIS_NONE;
+  }
+  t->irisRowScale = iScale;
+}
+
+// Pixel for polar[] value p within the iris square: iris if within the
+// scaled iris radius, otherwise the underlying sclera pixel at *s.
+static inline uint16_t irisPixel(const eyeTables *t, uint16_t p,
+  const scleraPixel *s) {
+  uint16_t r = t->irisRow[p & 0x7F];                  // Distance (Y)
+  if(r == IRIS_NONE) return SCLERA_COLOR(*s);         // Not in iris
+  return IRIS_COLOR(r + (IRIS_MAP_WIDTH * (p >> 7)) / 512);
+}
+
+
+// SCANLINES ---------------------------------------------------------------
+
+// Builds line screenY of an eye whose top left corner is at (scleraX,
+// scleraY) in the sclera image, for lid thresholds uT/lT.  lidSpans() and
+// irisRows() must have brought t up to date for these thresholds and iris
+// scale.  The line goes to the sink as begin(y), then black(n) and
+// pixel(p) calls (RGB565) covering all SCREEN_WIDTH pixels, then end();
+// it's a template so the sink's calls inline into the pixel loops.
+template <typename Sink>
+void eyeLine(Sink &sink, const eyeTables *t, uint8_t scleraX,
+  uint8_t scleraY, uint8_t uT, uint8_t lT, uint8_t screenY) {
+  uint8_t  x;
+  int16_t  irisX, irisY;
+  uint16_t p;
+
+  // The line is split into runs: eyelid at either end, and in between,
+  // sclera to the left of, the inside of, and to the right of the iris
+  // square.  The iris square spans columns [ix0, ix1) on every line; lines
+  // above and below it are sclera throughout.  Only the inside run needs
+  // the polar lookup.
+  scleraY += screenY;
+  irisY    = scleraY - (SCLERA_HEIGHT - IRIS_HEIGHT) / 2; // Row in iris
+  irisX    = scleraX - (SCLERA_WIDTH  - IRIS_WIDTH ) / 2; // Column 0
+  uint8_t ix0 = (irisX < 0) ? -irisX : 0,
+          ix1 = ((IRIS_WIDTH - irisX) < SCREEN_WIDTH) ?
+                 (IRIS_WIDTH - irisX) : SCREEN_WIDTH;
+  sink.begin(screenY);
+  const scleraPixel *sRow = &SCLERA_ROW(scleraY)[scleraX]; // By screen X
+  const uint8_t     *uRow = UPPER_ROW(screenY), *lRow = LOWER_ROW(screenY);
+  uint8_t            x1   = t->spanX1[screenY];          // Open run is [x, x1)
+  bool               holes = t->spanHoles[screenY];
+  x = t->spanX0[screenY];
+  sink.black(x);                                       // Eyelid left of run
+  if((irisY < 0) || (irisY >= IRIS_HEIGHT)) { // Outside iris square...
+    if(holes) {                               // ...lid inside the run?
+      for(; x<x1; x++) {
+        p = ((lRow[x] <= lT) || (uRow[x] <= uT)) ? 0 : SCLERA_COLOR(sRow[x]);
+        sink.pixel(p);
+      }
+    } else {                                  // ...all sclera
+      for(; x<x1; x++) sink.pixel(SCLERA_COLOR(sRow[x]));
+    }
+  } else {                                    // Crosses iris square
+    const uint16_t *pRow = POLAR_ROW(irisY);  // Indexed by iris X
+    if(holes) {                               // Per-pixel lid test
+      for(; x<x1; x++) {
+        if((lRow[x] <= lT) || (uRow[x] <= uT)) p = 0; // Covered by eyelid
+        else if((x < ix0) || (x >= ix1)) p = SCLERA_COLOR(sRow[x]); // Sclera
+        else p = irisPixel(t, pRow[irisX + x], &sRow[x]);
+        sink.pixel(p);
+      }
+    } else {
+      uint8_t xa = (ix0 < x1) ? ix0 : x1,     // End of left sclera run
+              xb = (ix1 < x1) ? ix1 : x1;     // End of iris square run
+      for(; x<xa; x++) sink.pixel(SCLERA_COLOR(sRow[x]));
+      for(; x<xb; x++) sink.pixel(irisPixel(t, pRow[irisX + x], &sRow[x]));
+      for(; x<x1; x++) sink.pixel(SCLERA_COLOR(sRow[x]));
+    }
+  }
+  sink.black(SCREEN_WIDTH - x1);                       // Eyelid right of run
+  sink.end();
+}
+
+// Lines [y0, y1) of the same, one after another
+template <typename Sink>
+void eyeLines(Sink &sink, const eyeTables *t, uint8_t scleraX,
+  uint8_t scleraY, uint8_t uT, uint8_t lT, uint8_t y0, uint8_t y1) {
+  for(uint8_t y=y0; y<y1; y++) eyeLine(sink, t, scleraX, scleraY, uT, lT, y);
+}
+
+#endif // _EYE_H_
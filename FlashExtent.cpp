@@ -0,0 +1,282 @@
+/*
+ * Raw flash access to files that sit in one unbroken run of clusters
+ */
+
+#ifndef USE_POSIX
+
+#include "FlashExtent.h"
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace {
+
+	const uint32_t SECTOR_SIZE = 512;
+	const uint32_t ENTRY_SIZE = 32;  // Directory entry
+	const uint8_t  ATTR_VOLUME_ID = 0x08;
+	const uint8_t  ATTR_DIRECTORY = 0x10;
+	const uint8_t  ATTR_LONG_NAME = 0x0F;
+
+	/* What locate() needs out of the boot sector */
+	struct FatGeometry
+	{
+		uint32_t fat_start;     // in bytes
+		uint32_t root_start;    // in bytes, FAT12/16 root directory
+		uint32_t root_sectors;  // 0 on FAT32
+		uint32_t root_cluster;  // FAT32 root directory
+		uint32_t data_start;    // in bytes, cluster 2
+		uint32_t cluster_size;  // in bytes
+		uint32_t num_clusters;
+		uint8_t  fat_bits;      // 12, 16 or 32
+	};
+
+	inline uint16_t le16(const uint8_t* p) {
+		return p[0] | (p[1] << 8);
+	}
+
+	inline uint32_t le32(const uint8_t* p) {
+		return le16(p) | ((uint32_t)le16(p + 2) << 16);
+	}
+
+	bool readGeometry(Adafruit_SPIFlash& flash, FatGeometry& geom) {
+		uint8_t sector[SECTOR_SIZE];
+		uint32_t volume = 0;
+		if (flash.readBuffer(0, sector, SECTOR_SIZE) != SECTOR_SIZE) {
+			return false;
+		}
+		if (sector[510] != 0x55 || sector[511] != 0xAA) {
+			return false;
+		}
+		/* No jump instruction: a partition table, use the first one */
+		if (sector[0] != 0xEB && sector[0] != 0xE9) {
+			volume = le32(&sector[446 + 8]) * SECTOR_SIZE;
+			if (flash.readBuffer(volume, sector, SECTOR_SIZE) != SECTOR_SIZE) {
+				return false;
+			}
+		}
+
+		uint16_t bytes_per_sector = le16(&sector[11]);
+		uint8_t  sectors_per_cluster = sector[13];
+		uint16_t reserved_sectors = le16(&sector[14]);
+		uint8_t  num_fats = sector[16];
+		uint16_t root_entries = le16(&sector[17]);
+		uint32_t total_sectors = le16(&sector[19]);
+		uint32_t fat_sectors = le16(&sector[22]);
+		if (!total_sectors) total_sectors = le32(&sector[32]);
+		if (!fat_sectors) fat_sectors = le32(&sector[36]);
+		if (bytes_per_sector != SECTOR_SIZE || !sectors_per_cluster || !num_fats) {
+			return false;
+		}
+
+		uint32_t root_sectors = (root_entries * 32 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		uint32_t data_sector = reserved_sectors + num_fats * fat_sectors + root_sectors;
+		if (data_sector >= total_sectors) {
+			return false;
+		}
+		geom.fat_start = volume + reserved_sectors * SECTOR_SIZE;
+		geom.root_start = geom.fat_start + num_fats * fat_sectors * SECTOR_SIZE;
+		geom.root_sectors = root_sectors;
+		geom.root_cluster = le32(&sector[44]);
+		geom.data_start = volume + data_sector * SECTOR_SIZE;
+		geom.cluster_size = sectors_per_cluster * SECTOR_SIZE;
+		geom.num_clusters = (total_sectors - data_sector) / sectors_per_cluster;
+		/* FAT type goes by cluster count, whatever the label says */
+		geom.fat_bits = (geom.num_clusters < 4085) ? 12 :
+			(geom.num_clusters < 65525) ? 16 : 32;
+		return true;
+	}
+
+	uint32_t nextCluster(Adafruit_SPIFlash& flash, const FatGeometry& geom,
+											 uint32_t cluster) {
+		uint8_t entry[4] = { 0 };
+		if (geom.fat_bits == 12) {
+			flash.readBuffer(geom.fat_start + cluster + cluster / 2, entry, 2);
+			uint16_t v = le16(entry);
+			return (cluster & 1) ? (v >> 4) : (v & 0x0FFF);
+		}
+		if (geom.fat_bits == 16) {
+			flash.readBuffer(geom.fat_start + cluster * 2, entry, 2);
+			return le16(entry);
+		}
+		flash.readBuffer(geom.fat_start + cluster * 4, entry, 4);
+		return le32(entry) & 0x0FFFFFFF;
+	}
+
+	bool isEndOfChain(const FatGeometry& geom, uint32_t next) {
+		if (geom.fat_bits == 12) return next >= 0x0FF8;
+		if (geom.fat_bits == 16) return next >= 0xFFF8;
+		return next >= 0x0FFFFFF8;
+	}
+
+	/* Does the chain from cluster run straight on for numClusters? */
+	bool isContiguous(Adafruit_SPIFlash& flash, const FatGeometry& geom,
+										uint32_t cluster, uint32_t numClusters) {
+		for (uint32_t i = 1; i < numClusters; i++, cluster++) {
+			if (nextCluster(flash, geom, cluster) != cluster + 1) {
+				return false;
+			}
+		}
+		return isEndOfChain(geom, nextCluster(flash, geom, cluster));
+	}
+
+	uint32_t clusterAddress(const FatGeometry& geom, uint32_t cluster) {
+		return geom.data_start + (cluster - 2) * geom.cluster_size;
+	}
+
+	/* An 8.3 entry's name as "NAME.EXT" */
+	void shortName(const uint8_t* entry, char* name) {
+		int n = 0;
+		for (int i = 0; i < 8 && entry[i] != ' '; i++) {
+			name[n++] = (i == 0 && entry[0] == 0x05) ? (char)0xE5 : entry[i];
+		}
+		if (entry[8] != ' ') {
+			name[n++] = '.';
+			for (int i = 8; i < 11 && entry[i] != ' '; i++) name[n++] = entry[i];
+		}
+		name[n] = 0;
+	}
+
+	/* Add a long file name entry's 13 characters to name, at the place
+	 * its sequence number says.  Anything outside ASCII becomes '?',
+	 * which is then just a name that doesn't match.
+	 */
+	void longNamePart(const uint8_t* entry, char* name) {
+		static const uint8_t offsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+		unsigned int start = ((entry[0] & 0x1F) - 1) * 13;
+		for (int i = 0; i < 13; i++) {
+			uint16_t c = le16(entry + offsets[i]);
+			if (!c) break;
+			name[start + i] = (c < 0x80) ? (char)c : '?';
+		}
+	}
+
+	/* Look through a directory (starting cluster, or 0 for a FAT12/16
+	 * root) for name, by its long name or its 8.3 one.  Copies the
+	 * entry out if found.
+	 */
+	bool findEntry(Adafruit_SPIFlash& flash, const FatGeometry& geom,
+								 uint32_t dir, const char* name, uint8_t* found) {
+		uint8_t sector[SECTOR_SIZE];
+		char longName[20 * 13 + 1]; /* Longest the sequence number allows */
+		char name83[13];
+		bool haveLong = false;
+		uint32_t cluster = dir;
+		uint32_t addr = dir ? clusterAddress(geom, dir) : geom.root_start;
+		uint32_t sectors = dir ? geom.cluster_size / SECTOR_SIZE : geom.root_sectors;
+		for (uint32_t hops = 0; hops <= geom.num_clusters; hops++) {
+			for (uint32_t s = 0; s < sectors; s++) {
+				if (flash.readBuffer(addr + s * SECTOR_SIZE, sector, SECTOR_SIZE) != SECTOR_SIZE) {
+					return false;
+				}
+				for (uint32_t e = 0; e < SECTOR_SIZE; e += ENTRY_SIZE) {
+					const uint8_t* entry = &sector[e];
+					uint8_t attr = entry[11];
+					if (entry[0] == 0x00) return false; /* End of the directory */
+					if (entry[0] == 0xE5) {             /* Deleted */
+						haveLong = false;
+					}
+					else if (attr == ATTR_LONG_NAME) {
+						if (entry[0] & 0x40) {            /* Last part comes first */
+							memset(longName, 0, sizeof(longName));
+							haveLong = true;
+						}
+						if ((entry[0] & 0x1F) == 0 || (entry[0] & 0x1F) > 20) {
+							haveLong = false; /* Not one we can have made */
+						}
+						if (haveLong) longNamePart(entry, longName);
+					}
+					else {
+						shortName(entry, name83);
+						if (!(attr & ATTR_VOLUME_ID) &&
+								((haveLong && !strcasecmp(longName, name)) || !strcasecmp(name83, name))) {
+							memcpy(found, entry, ENTRY_SIZE);
+							return true;
+						}
+						haveLong = false;
+					}
+				}
+			}
+			if (!dir) return false; /* The FAT12/16 root doesn't grow */
+			cluster = nextCluster(flash, geom, cluster);
+			if (cluster < 2 || cluster >= geom.num_clusters + 2) return false;
+			addr = clusterAddress(geom, cluster);
+		}
+		return false;
+	}
+
+	uint32_t entryCluster(const uint8_t* entry) {
+		return le16(&entry[26]) | ((uint32_t)le16(&entry[20]) << 16);
+	}
+
+	/* Walk an absolute path down from the root to its directory entry */
+	bool findPath(Adafruit_SPIFlash& flash, const FatGeometry& geom,
+								const char* path, uint8_t* found) {
+		char name[256];
+		uint32_t dir = (geom.fat_bits == 32) ? geom.root_cluster : 0;
+		bool any = false;
+		while (*path) {
+			while (*path == '/') path++;
+			size_t len = strcspn(path, "/");
+			if (!len) break;
+			if (len >= sizeof(name)) return false;
+			if (any && !(found[11] & ATTR_DIRECTORY)) return false;
+			if (any) dir = entryCluster(found); /* 0 is the root again */
+			if (!dir && geom.fat_bits == 32) dir = geom.root_cluster;
+			memcpy(name, path, len);
+			name[len] = 0;
+			if (!findEntry(flash, geom, dir, name, found)) return false;
+			any = true;
+			path += len;
+		}
+		return any;
+	}
+
+}
+
+
+bool FlashExtentFileWrapper::locate(FileWrapper& file, Adafruit_SPIFlash& flash,
+																		uint32_t* address, uint32_t* size) {
+	FatGeometry geom;
+	if (!readGeometry(flash, geom)) {
+		return false;
+	}
+
+	/* Where the file's own directory entry says it starts */
+	uint8_t entry[ENTRY_SIZE];
+	if (!findPath(flash, geom, file.fileName().c_str(), entry) ||
+			(entry[11] & ATTR_DIRECTORY)) {
+		return false;
+	}
+	uint32_t cluster = entryCluster(entry);
+	uint32_t file_size = le32(&entry[28]);
+	uint32_t num_clusters = (file_size + geom.cluster_size - 1) / geom.cluster_size;
+	if (!file_size || cluster < 2 || cluster - 2 + num_clusters > geom.num_clusters) {
+		return false;
+	}
+
+	/* Check that against FatFs: same size, same first sector */
+	uint8_t first[SECTOR_SIZE];
+	uint8_t probe[SECTOR_SIZE];
+	if (!file.open()) {
+		return false;
+	}
+	long fs_size = file.size();
+	size_t first_size = file.read(first, SECTOR_SIZE);
+	file.close();
+	uint32_t addr = clusterAddress(geom, cluster);
+	if (fs_size != (long)file_size || !first_size ||
+			flash.readBuffer(addr, probe, first_size) != first_size ||
+			memcmp(probe, first, first_size)) {
+		return false;
+	}
+
+	if (!isContiguous(flash, geom, cluster, num_clusters)) {
+		return false;
+	}
+	*address = addr;
+	*size = file_size;
+	return true;
+}
+
+#endif // USE_POSIX
@@ -0,0 +1,79 @@
+/*
+ * Raw flash access to files that sit in one unbroken run of clusters
+ */
+
+#ifndef FLASHEXTENT_H
+#define FLASHEXTENT_H
+
+#ifndef USE_POSIX
+
+#include "WavLoader.h"
+
+#include <Adafruit_SPIFlash.h>
+
+// Reads a file straight out of the SPI flash by address, skipping FatFs
+// (and its cluster chain walk on every seek).  Only good for a file that
+// isn't fragmented and doesn't change while it's open, which locate()
+// checks before handing out an address.
+class FlashExtentFileWrapper final : public FileWrapper {
+ public:
+ FlashExtentFileWrapper(const char* fileName, Adafruit_SPIFlash& flash,
+												uint32_t address, uint32_t size)
+	 : FileWrapper(fileName), _flash(flash), _address(address)
+		, _size(size), _position(0)
+	{
+	}
+
+	/* Find where file's contents start in flash: the first cluster in
+	 * its directory entry (file's name must be its full path), as long
+	 * as that agrees with FatFs and the FAT chain runs straight through
+	 * to the end of it.  Returns false if the filesystem isn't FAT /
+	 * 512-byte sectors, or if the file's fragmented.
+	 */
+	static bool locate(FileWrapper& file, Adafruit_SPIFlash& flash,
+										 uint32_t* address, uint32_t* size);
+
+	virtual size_t	write(const void*, size_t) {
+		return 0; // Read only
+	}
+
+	virtual size_t	read(void* buf, size_t size) {
+		if (_position >= _size) {
+			return 0;
+		}
+		if (size > _size - _position) {
+			size = _size - _position;
+		}
+		uint32_t result = _flash.readBuffer(_address + _position, (uint8_t*)buf, size);
+		_position += result;
+		return result;
+	}
+
+	virtual bool		seek(size_t pos) {
+		if (pos > _size) {
+			return false;
+		}
+		_position = pos;
+		return true;
+	}
+
+	virtual long		position() { return _position; }
+	virtual long		size() { return _size; }
+
+	virtual bool		open() {
+		_position = 0;
+		return true;
+	}
+
+	virtual void		close() { }
+
+ private:
+	Adafruit_SPIFlash& _flash;
+	uint32_t _address;  // flash address of the file's first byte
+	uint32_t _size;     // in bytes
+	uint32_t _position; // in bytes
+};
+
+#endif // USE_POSIX
+
+#endif // FLASHEXTENT_H
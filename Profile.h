@@ -0,0 +1,126 @@
+// Cycle counting for the sketch's time-critical stages.  profCycles() is
+// always there; with PROFILE defined (config.h) each stage also keeps a
+// count, min, max, total and a histogram, and profDump() prints the lot on
+// one line and starts over.  Recording is a few dozen cycles and works the
+// same from interrupts, nothing is printed until profDump() is asked for.
+// Include once, after config.h.
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+// Cortex-M4 and Teensy 3 have a free-running cycle counter in the DWT.
+// The M0+ doesn't, so there it's made up from millis() and SysTick's
+// position in the current millisecond (as micros() does, but without the
+// divide); it wraps every 2^32 cycles either way, so only differences
+// mean anything.
+#if defined(ARM_DWT_CYCCNT) // Teensy 3
+static inline void profInit(void) {
+  ARM_DEMCR    |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+static inline uint32_t profCycles(void) { return ARM_DWT_CYCCNT; }
+#elif defined(DWT) && (__CORTEX_M >= 3) // SAMD51 etc.
+static inline void profInit(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+}
+static inline uint32_t profCycles(void) { return DWT->CYCCNT; }
+#else // SAMD21: SysTick counts down from LOAD once per millisecond
+static inline void profInit(void) { }
+static inline uint32_t profCycles(void) {
+  uint32_t ms, ticks, pending;
+  do {
+    ms      = millis();
+    ticks   = SysTick->VAL;
+    pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+  } while(ms != millis());
+  // In an interrupt that's holding off SysTick, the counter may have
+  // wrapped without millis() hearing about it yet
+  if(pending && (ticks > (SysTick->LOAD / 2))) ms++;
+  return ms * (SysTick->LOAD + 1) + (SysTick->LOAD - ticks);
+}
+#endif
+
+#ifdef PROFILE
+
+enum {          // Stages timed, and their names in profDump():
+  PROF_PIXELS,  // "pixels" drawEye() computing, minus display waits
+  PROF_DISPLAY, // "display" drawEye() waiting on SPI/DMA (full ring or
+                //   the previous frame still going out)
+  PROF_AUDIO,   // "audio" DAC interrupt: one DMA half or sample refill
+  PROF_TICK,    // "tick" primeStream() on TC5, incl. servo
+  PROF_REFILL,  // "refill" audioService() flash reads, when it ran
+  PROF_JAW,     // "jaw" envelope (RMS) update and servo write, also
+                //   counted in whichever of the above it happened in
+  PROF_STAGES
+};
+
+#define PROF_BUCKETS 12 // Histogram bucket b: 4^b to 4^(b+1)-1 cycles,
+                        // the last one everything from 4^11 up
+
+typedef struct {
+  uint32_t count, min, max;
+  uint64_t total;
+  uint16_t hist[PROF_BUCKETS]; // Saturate, rather than wrap
+} profStage;
+
+profStage profStages[PROF_STAGES];
+
+static const char *const profNames[PROF_STAGES] = {
+  "pixels", "display", "audio", "tick", "refill", "jaw" };
+
+// Record one stage taking the given number of cycles.  Interrupts are
+// held off for the update only, so stages shared between interrupts of
+// different priorities stay consistent.
+static void profAdd(uint8_t stage, uint32_t cycles) {
+  uint32_t primask;
+  uint8_t  b;
+  for(b=0; (b < PROF_BUCKETS-1) && (cycles >> (2 * b + 2)); b++);
+  asm volatile("mrs %0, primask\n cpsid i" : "=r"(primask) :: "memory");
+  profStage *s = &profStages[stage];
+  if(!s->count || (cycles < s->min)) s->min = cycles;
+  if(cycles > s->max)                s->max = cycles;
+  s->count++;
+  s->total += cycles;
+  if(s->hist[b] < 0xFFFF) s->hist[b]++;
+  asm volatile("msr primask, %0" :: "r"(primask) : "memory");
+}
+
+// Print every stage that ran since the last dump and clear them, as:
+//   prof <cycles/s> <name> <count> <min> <avg> <max> <4^0 hist>:...:<4^11>
+// (one line, stages separated by " | ").  Call from the main loop only.
+void profDump(void) {
+  static profStage snap[PROF_STAGES]; // Static, too big for the stack
+  uint32_t primask;
+  asm volatile("mrs %0, primask\n cpsid i" : "=r"(primask) :: "memory");
+  memcpy(snap, profStages, sizeof snap);
+  memset(profStages, 0, sizeof profStages);
+  asm volatile("msr primask, %0" :: "r"(primask) : "memory");
+
+  Serial.print("prof ");
+  Serial.print(F_CPU);
+  for(uint8_t i=0; i<PROF_STAGES; i++) {
+    profStage *s = &snap[i];
+    if(!s->count) continue;
+    Serial.print(" | ");
+    Serial.print(profNames[i]);
+    Serial.print(' '); Serial.print(s->count);
+    Serial.print(' '); Serial.print(s->min);
+    Serial.print(' '); Serial.print((uint32_t)(s->total / s->count));
+    Serial.print(' '); Serial.print(s->max);
+    for(uint8_t b=0; b<PROF_BUCKETS; b++) {
+      Serial.print(b ? ':' : ' ');
+      Serial.print(s->hist[b]);
+    }
+  }
+  Serial.println();
+}
+
+  #define PROFILE_START(t)   uint32_t t = profCycles()
+  #define PROFILE_END(s, t)  profAdd(s, profCycles() - (t))
+#else
+  #define PROFILE_START(t)
+  #define PROFILE_END(s, t)
+#endif // PROFILE
+
+#endif // _PROFILE_H_
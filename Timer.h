@@ -75,7 +75,9 @@ typedef void (*Timer_Callback)(void* context);
 
   REG_TC4_INTFLAG |= TC_INTFLAG_MC0;  // Clear the interrupt flags
   REG_TC4_INTENCLR = TC_INTENCLR_MC1 | TC_INTENCLR_OVF;     // Disable TC4 interrupts
-  REG_TC4_INTENSET = TC_INTENSET_MC0; // Enable TC4 interrupts
+  if (sampleCallback) {                 // No callback: TC4 only paces DMA
+    REG_TC4_INTENSET = TC_INTENSET_MC0; // Enable TC4 interrupts
+  }
 
   REG_TC4_CTRLA |= TC_CTRLA_PRESCALER_DIV64 | // Set freq to 3MHz
                    TC_CTRLA_WAVEGEN_MFRQ;   // Use the counter as the freq
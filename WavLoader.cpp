@@ -3,9 +3,11 @@
  */
 
 #include "WavLoader.h"
+#include "FlashExtent.h"
 
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 
 namespace {
@@ -25,26 +27,87 @@ namespace {
 	const static chunk_tag_t WAVE_TAG = {'W', 'A', 'V', 'E'};
 	const static chunk_tag_t FMT_TAG = {'f', 'm', 't', ' '};
 	const static chunk_tag_t DATA_TAG {'d', 'a', 't', 'a'};
+	const static chunk_tag_t JAW_TAG = {'j', 'a', 'w', ' '};
+	const static chunk_tag_t FACT_TAG = {'f', 'a', 'c', 't'};
+	const static chunk_tag_t SMPL_TAG = {'s', 'm', 'p', 'l'};
 	
 	struct __attribute__((packed)) RIFFChunkHeader
 	{
 		chunk_tag_t chunk_tag;
 		uint32_t chunk_size;
 	};
+
+	/* What follows WavFormat in an IMA ADPCM 'fmt ' chunk */
+	struct __attribute__((packed)) IMAFormatTail
+	{
+		uint16_t extra_size;
+		uint16_t samples_per_block;
+	};
+
+	/* Start of a 'smpl' (sampler) chunk, followed by num_sample_loops
+	 * SampleLoops and then sampler_data bytes of anything
+	 */
+	struct __attribute__((packed)) SamplerChunk
+	{
+		uint32_t manufacturer;
+		uint32_t product;
+		uint32_t sample_period;     // in nanoseconds
+		uint32_t midi_unity_note;
+		uint32_t midi_pitch_fraction;
+		uint32_t smpte_format;
+		uint32_t smpte_offset;
+		uint32_t num_sample_loops;
+		uint32_t sampler_data;
+	};
+
+	struct __attribute__((packed)) SampleLoop
+	{
+		uint32_t cue_point_id;
+		uint32_t type;              // 0 forward, 1 ping-pong, 2 backward
+		uint32_t start;             // in samples
+		uint32_t end;               // in samples, last one played
+		uint32_t fraction;
+		uint32_t play_count;        // 0 forever
+	};
+
+	const static int8_t IMA_INDEX_TABLE[16] = {
+		-1, -1, -1, -1, 2, 4, 6, 8,
+		-1, -1, -1, -1, 2, 4, 6, 8
+	};
+
+	const static int16_t IMA_STEP_TABLE[89] = {
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+		19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+		50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+		130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+		337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+		876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+		2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+		5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+		15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+	};
 	
 }
 
 
-WavLoader::~WavLoader() {
+template <typename FileType>
+BasicWavLoader<FileType>::~BasicWavLoader() {
 	
 }
 
-bool WavLoader::open(FileWrapper* wrapper) {
+template <typename FileType>
+bool BasicWavLoader<FileType>::open(FileType* wrapper) {
 	if(!wrapper) {
 		return false;
 	}
 
 	_file = wrapper;
+	_jaw_frames = 0;
+	_jaw_rate = 0;
+	_samples_per_block = 1;
+	_loop_start = _loop_end = 0;
+	uint32_t data_bytes = 0;
+	uint32_t fact_length = 0;
 
 	/* Open the file and seek to the beginning */
 	bool didOpen = _file->open();
@@ -101,11 +164,54 @@ bool WavLoader::open(FileWrapper* wrapper) {
 				_file->close();
 				return false;
 			}
+			if (_format.audio_format == kIMAADPCMFormat) {
+				IMAFormatTail tail;
+				numRead = _file->read(&tail, sizeof(tail));
+				if (numRead != sizeof(tail) || !tail.samples_per_block) {
+					_file->close();
+					return false;
+				}
+				_samples_per_block = tail.samples_per_block;
+			}
 		}
 		else if (header.chunk_tag == DATA_TAG) {
-			_length = header.chunk_size / _format.block_align;
+			data_bytes = header.chunk_size;
 			_data_offset = (uint32_t)pos;
 		}
+		else if (header.chunk_tag == FACT_TAG) {
+			// Sample count, which compressed formats need
+			_file->read(&fact_length, sizeof(fact_length));
+		}
+		else if (header.chunk_tag == JAW_TAG &&
+						 header.chunk_size >= sizeof(JawTrackHeader)) {
+			// Jaw track, optional
+			JawTrackHeader jaw;
+			numRead = _file->read(&jaw, sizeof(jaw));
+			if (numRead == sizeof(jaw) && jaw.frame_rate) {
+				_jaw_rate = jaw.frame_rate;
+				_jaw_frames = header.chunk_size - sizeof(jaw);
+				_jaw_offset = (uint32_t)pos + sizeof(jaw);
+			}
+		}
+		else if (header.chunk_tag == SMPL_TAG &&
+						 header.chunk_size >= sizeof(SamplerChunk) + sizeof(SampleLoop)) {
+			// Loop points, optional: the first forward loop, if any
+			SamplerChunk smpl;
+			SampleLoop loop;
+			numRead = _file->read(&smpl, sizeof(smpl));
+			uint32_t num_loops = (numRead == sizeof(smpl)) ? smpl.num_sample_loops : 0;
+			if (num_loops > (header.chunk_size - sizeof(smpl)) / sizeof(loop)) {
+				num_loops = (header.chunk_size - sizeof(smpl)) / sizeof(loop);
+			}
+			for (uint32_t i = 0; i < num_loops; i++) {
+				if (_file->read(&loop, sizeof(loop)) != sizeof(loop)) break;
+				if (loop.type == 0 && loop.end >= loop.start) {
+					_loop_start = loop.start;
+					_loop_end = loop.end + 1;
+					break;
+				}
+			}
+		}
 		
 		/* If we're done, bail */
 		if (_file_size <= next_chunk_pos) {
@@ -118,41 +224,139 @@ bool WavLoader::open(FileWrapper* wrapper) {
 		}
 	}
 	
-	_position = 0;
+	if (!_format.block_align) {
+		_file->close();
+		return false;
+	}
+	if (isIMAADPCM()) {
+		/* Last block may be short, and the fact chunk knows best */
+		uint32_t tail_bytes = data_bytes % _format.block_align;
+		_length = (data_bytes / _format.block_align) * _samples_per_block;
+		if (tail_bytes > 4u * _format.num_channels) {
+			_length += 1 + (tail_bytes - 4u * _format.num_channels) * 2 / _format.num_channels;
+		}
+		if (fact_length && fact_length < _length) {
+			_length = fact_length;
+		}
+	}
+	else {
+		_length = data_bytes / _format.block_align;
+	}
+	if (_loop_end > _length) _loop_end = _length;
+	if (_loop_start >= _loop_end) _loop_start = _loop_end = 0;
 	
+	if (!seek(0)) {
+		_file->close();
+		return false;
+	}
 	return true;
 }
 
-static inline uint32_t MIN(uint32_t a, uint32_t b) {
-	return a<b?a:b;
+template <typename FileType>
+bool BasicWavLoader<FileType>::open(FileType* wrapper, const WavInfo& info) {
+	if(!wrapper || !wrapper->open()) {
+		_file = NULL;
+		return false;
+	}
+	_file = wrapper;
+	_format = info.format;
+	_length = info.length;
+	_data_offset = info.data_offset;
+	_file_size = info.file_size;
+	_jaw_offset = info.jaw_offset;
+	_jaw_frames = info.jaw_frames;
+	_jaw_rate = info.jaw_rate;
+	_samples_per_block = info.samples_per_block;
+	_loop_start = info.loop_start;
+	_loop_end = info.loop_end;
+	if (!seek(0)) {
+		_file->close();
+		_file = NULL;
+		return false;
+	}
+	return true;
 }
 
-static inline uint32_t MAX(uint32_t a, uint32_t b) {
-	return a>=b?a:b;
+template <typename FileType>
+WavInfo BasicWavLoader<FileType>::info() {
+	WavInfo info;
+	info.format = _format;
+	info.length = _length;
+	info.data_offset = _data_offset;
+	info.file_size = _file_size;
+	info.jaw_offset = _jaw_offset;
+	info.jaw_frames = _jaw_frames;
+	info.jaw_rate = _jaw_rate;
+	info.samples_per_block = _samples_per_block;
+	info.loop_start = _loop_start;
+	info.loop_end = _loop_end;
+	return info;
 }
 
-uint32_t WavLoader::filePositionForSample(uint32_t sample_pos) {
-	uint32_t clippedSamplePos = MIN(sample_pos, numSamples());
-	uint32_t result =	_data_offset + clippedSamplePos * frameAlignment();
-	return result;
+static inline uint32_t MIN(uint32_t a, uint32_t b) {
+	return a<b?a:b;
 }
 
-uint32_t WavLoader::position() {
-	return _position;
+/* Reads up to maxFrames of the jaw track, leaves position() at
+ * kUnknownPosition (seek() before reading samples again)
+ */
+template <typename FileType>
+uint32_t BasicWavLoader<FileType>::readJawTrack(uint8_t* buf, uint32_t maxFrames) {
+	if (!_jaw_frames) {
+		return 0;
+	}
+	_position = kUnknownPosition;
+	if (!_file->seek(_jaw_offset)) {
+		return 0;
+	}
+	return _file->read(buf, MIN(maxFrames, _jaw_frames));
 }
 
-bool WavLoader::seek(uint32_t position) {
-	_position = filePositionForSample(position);
-	return _file->seek(_position);
-}
+uint32_t decodeIMABlock(const uint8_t* block, uint32_t blockSize,
+												int16_t* out, uint32_t maxSamples) {
+	if (blockSize < 4 || !maxSamples) {
+		return 0;
+	}
+	/* Header: first sample as is, then the starting step index */
+	int32_t predictor = (int16_t)(block[0] | (block[1] << 8));
+	int index = block[2];
+	if (index > 88) index = 88;
+	out[0] = (int16_t)predictor;
+	uint32_t n = 1;
 
-uint32_t WavLoader::read(void* buf, uint32_t bufSize) {
-	uint32_t num_read = _file->read(buf, bufSize);
-	return num_read;
+	for (uint32_t i = 4; i < blockSize && n < maxSamples; i++) {
+		uint8_t byte = block[i];
+		for (int half = 0; half < 2 && n < maxSamples; half++) {
+			uint8_t nibble = half ? (byte >> 4) : (byte & 0x0f);
+			int32_t step = IMA_STEP_TABLE[index];
+			int32_t diff = step >> 3;
+			if (nibble & 1) diff += step >> 2;
+			if (nibble & 2) diff += step >> 1;
+			if (nibble & 4) diff += step;
+			predictor += (nibble & 8) ? -diff : diff;
+			if (predictor > 32767) predictor = 32767;
+			else if (predictor < -32768) predictor = -32768;
+			index += IMA_INDEX_TABLE[nibble];
+			if (index < 0) index = 0;
+			else if (index > 88) index = 88;
+			out[n++] = (int16_t)predictor;
+		}
+	}
+	return n;
 }
 
-void WavLoader::close() {
+template <typename FileType>
+void BasicWavLoader<FileType>::close() {
 	if (_file) {
 		_file->close();
 	}
 }
+
+template class BasicWavLoader<FileWrapper>;
+template class BasicWavLoader<MemoryFileWrapper>;
+#ifdef USE_POSIX
+template class BasicWavLoader<PosixFileWrapper>;
+#else
+template class BasicWavLoader<SDFileWrapper>;
+template class BasicWavLoader<FlashExtentFileWrapper>;
+#endif
@@ -6,9 +6,16 @@
 #define WAVLOADER_H
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 
 const uint16_t kPCMFormat = 0x01;
+const uint16_t kIMAADPCMFormat = 0x11;
+
+/* Biggest IMA ADPCM block handled (1017 mono samples), so decoders can
+ * get by with a fixed buffer
+ */
+const uint16_t kMaxIMABlockAlign = 512;
 
 struct __attribute__((packed)) WavFormat
 {
@@ -27,6 +34,16 @@ struct __attribute__((packed)) WavFormatExtended
 	char     sub_format[16];
 };
 
+/* Optional 'jaw ' chunk: a pre-analyzed jaw servo track for the clip.
+ * The header is followed by one uint8_t jaw angle (degrees) per frame,
+ * frame_rate frames per second from the start of the sample data.
+ */
+struct __attribute__((packed)) JawTrackHeader
+{
+	uint16_t frame_rate;
+	uint16_t reserved;
+};
+
 struct __attribute__((packed)) SimpleWavHeader
 {
 	char ChunkID[4];
@@ -39,8 +56,35 @@ struct __attribute__((packed)) SimpleWavHeader
 	uint32_t SubChunk2Size;
 };
 
+/* Everything open() learns from walking a file's chunks, so the file can
+ * be reopened later without walking them again
+ */
+struct WavInfo
+{
+	WavFormat format;
+	uint32_t length;      // in samples
+	uint32_t data_offset; // in bytes
+	uint32_t file_size;   // in bytes
+	uint32_t jaw_offset;  // in bytes, 0 if no jaw track
+	uint32_t jaw_frames;
+	uint16_t jaw_rate;    // jaw track frames per second
+	uint16_t samples_per_block; // per block_align bytes, 1 for PCM
+	uint32_t loop_start;  // in samples, from a 'smpl' chunk, and
+	uint32_t loop_end;    // the sample after the loop, 0 if no loop
+};
+
+/* Decodes one mono IMA ADPCM block (or the start of one, if blockSize
+ * is short), returns the number of samples written to out
+ */
+uint32_t decodeIMABlock(const uint8_t* block, uint32_t blockSize,
+												int16_t* out, uint32_t maxSamples);
+
 // Needs to work with
 //	open / close AND SdFat.h
+//
+// The loader and streams take the file type as a template parameter:
+// FileWrapper itself when files of different kinds get mixed (virtual
+// calls), or one of the final classes below so the calls inline.
 
 class FileWrapper {
  public:
@@ -74,7 +118,7 @@ class FileWrapper {
 #ifdef USE_POSIX
 #include <cstdio>
 
-class PosixFileWrapper : public FileWrapper {
+class PosixFileWrapper final : public FileWrapper {
 
  public:
  PosixFileWrapper(std::string fileName)
@@ -165,9 +209,7 @@ class PosixFileWrapper : public FileWrapper {
 #include <Adafruit_SPIFlash_FatFs.h>
 
 // Arduino / esp8266 file interface wrapper
-// TODO: get rid of the virtual functions.
-//	We know darn well what kind of object this is.
-class SDFileWrapper : public FileWrapper {
+class SDFileWrapper final : public FileWrapper {
  public:
  SDFileWrapper(std::string fileName, Adafruit_W25Q16BV_FatFs& fatfs)
 	 : FileWrapper(fileName), _fs(fatfs)
@@ -191,15 +233,24 @@ class SDFileWrapper : public FileWrapper {
 		if (!_file) {
 			return 0;
 		}
-		// ¯\_(ツ)_/¯ 64k ought to be enough for anybody
-		int result = _file.read(buf, (uint16_t)size);
-		return (size_t)result;
+		// File::read() takes a uint16_t, so big reads go in pieces
+		size_t total = 0;
+		while (total < size) {
+			size_t chunk = size - total;
+			if (chunk > kMaxReadChunk) chunk = kMaxReadChunk;
+			int result = _file.read((uint8_t*)buf + total, (uint16_t)chunk);
+			if (result <= 0) break;
+			total += result;
+			if ((size_t)result < chunk) break;
+		}
+		return total;
 	}
 
 	virtual bool		seek(size_t pos) {
 		if(_file) {
-			_file.seek((uint32_t)pos);
+			return _file.seek((uint32_t)pos);
 		}
+		return false;
 	}
 	
 	virtual long		position() {
@@ -220,6 +271,8 @@ class SDFileWrapper : public FileWrapper {
 		_file.flush();
 	}
 
+	static const size_t kMaxReadChunk = 0x8000;
+
 	virtual bool		open() {
     _file = _fs.open(fileName().c_str(), (uint8_t)FILE_READ);  
     return (bool)(_file);
@@ -237,49 +290,199 @@ class SDFileWrapper : public FileWrapper {
 };
 #endif
 
-class WavLoader
+// A file that's already in memory (e.g. in program flash)
+class MemoryFileWrapper final : public FileWrapper {
+ public:
+ MemoryFileWrapper(const char* fileName, const void* data, size_t size)
+	 : FileWrapper(fileName), _data((const uint8_t*)data), _size(size)
+		, _position(0)
+	{
+	}
+
+	virtual size_t	write(const void*, size_t) {
+		return 0; // Read only
+	}
+
+	virtual size_t	read(void* buf, size_t size) {
+		if (_position >= _size) {
+			return 0;
+		}
+		if (size > _size - _position) {
+			size = _size - _position;
+		}
+		memcpy(buf, _data + _position, size);
+		_position += size;
+		return size;
+	}
+
+	virtual bool		seek(size_t pos) {
+		if (pos > _size) {
+			return false;
+		}
+		_position = pos;
+		return true;
+	}
+
+	virtual long		position() { return _position; }
+	virtual long		size() { return _size; }
+
+	virtual bool		open() {
+		_position = 0;
+		return true;
+	}
+
+	virtual void		close() { }
+
+ private:
+	const uint8_t* _data;
+	size_t _size;
+	size_t _position;
+};
+
+// Explicitly instantiated in WavLoader.cpp for FileWrapper and each of
+// the file types above; add a line there for a new one.
+template <typename FileType>
+class BasicWavLoader
 {
 	
  public:
 
-	WavLoader()
+	BasicWavLoader()
 		: _format()
 		, _file(nullptr)
 		, _length(0)
 		, _data_offset(0)
 		, _file_size(0)
+		, _jaw_offset(0)
+		, _jaw_frames(0)
+		, _jaw_rate(0)
+		, _samples_per_block(1)
+		, _loop_start(0)
+		, _loop_end(0)
 	{};
 	
-	bool open(FileWrapper* file);
+	bool open(FileType* file);
+	/* Reopen a file seen before, trusting the info saved from then */
+	bool open(FileType* file, const WavInfo& info);
+	WavInfo info();
 	void close();
 
-	/* Seeks in terms of samples */
-	bool seek(uint32_t position);
-	uint32_t position();
+	/* Seeks in terms of samples (for IMA ADPCM, to the start of the
+	 * block holding the sample).  position() is then the sample the
+	 * next read() starts at, kUnknownPosition if nothing's been read
+	 * or seeked to since the file was used for something else.
+	 */
+	static constexpr uint32_t kUnknownPosition = 0xFFFFFFFF;
+	bool seek(uint32_t position) {
+		uint32_t clipped = (position < _length) ? position : _length;
+		clipped -= clipped % _samples_per_block;
+		if (!_file->seek(filePositionForSample(clipped))) {
+			_position = kUnknownPosition;
+			return false;
+		}
+		_position = clipped;
+		return true;
+	}
+	uint32_t position() { return _position; }
 	
-	/* Reads full samples only */
-	uint32_t read(void* buf, uint32_t bufSize);
+	/* Reads full samples only (whole blocks, for IMA ADPCM), and stops at
+	 * the end of the sample data.  Returns the number of bytes read.
+	 */
+	uint32_t read(void* buf, uint32_t bufSize) {
+		uint32_t num_read = _file->read(buf, clipRead(bufSize));
+		advance(num_read);
+		return num_read;
+	}
+
+	/* Scatter read: fills buf1, then carries straight on into buf2, e.g.
+	 * two slots of a ring that wraps between them
+	 */
+	uint32_t read(void* buf1, uint32_t size1, void* buf2, uint32_t size2) {
+		uint32_t total = clipRead(size1 + size2);
+		if (total < size1) size1 = total;
+		size2 = total - size1;
+		uint32_t num_read = _file->read(buf1, size1);
+		if (num_read == size1 && size2) {
+			num_read += _file->read(buf2, size2);
+		}
+		advance(num_read);
+		return num_read;
+	}
 	
 	uint32_t sampleRate() { return _format.sample_rate; }
 	uint16_t bitsPerSample() { return _format.bits_per_sample; }
 	uint16_t numChannels() { return _format.num_channels; }
 	uint32_t numSamples() { return _length; }
 	uint16_t frameAlignment() { return _format.block_align; }
+
+	/* IMA ADPCM packs samplesPerBlock() samples into each block of
+	 * frameAlignment() bytes, which can only be decoded from the top:
+	 * seek() rounds down to a block boundary and read() returns the
+	 * packed bytes, for decodeIMABlock().
+	 */
+	bool isIMAADPCM() { return _format.audio_format == kIMAADPCMFormat; }
+	uint16_t samplesPerBlock() { return _samples_per_block; }
 	
 	uint32_t fileSize() { return _file_size; }
 
-	uint32_t filePositionForSample(uint32_t sample_num);
+	/* Jaw track, if the file has a 'jaw ' chunk (0 frames if not) */
+	uint32_t jawFrameRate() { return _jaw_rate; }
+	uint32_t jawNumFrames() { return _jaw_frames; }
+	uint32_t readJawTrack(uint8_t* buf, uint32_t maxFrames);
+
+	/* Loop, if the file has a 'smpl' chunk with a forward loop in it:
+	 * samples [loopStart(), loopEnd()), loopEnd() 0 if there's none
+	 */
+	bool hasLoop() { return _loop_end != 0; }
+	uint32_t loopStart() { return _loop_start; }
+	uint32_t loopEnd() { return _loop_end; }
+
+	uint32_t filePositionForSample(uint32_t sample_num) {
+		uint32_t clipped = (sample_num < _length) ? sample_num : _length;
+		return _data_offset + (clipped / _samples_per_block) * frameAlignment();
+	}
 	
-	~WavLoader();
+	~BasicWavLoader();
 	
  private:
+
+	/* Bytes of a read of bufSize that are whole samples (or blocks) and
+	 * still inside the sample data, going by _position
+	 */
+	uint32_t clipRead(uint32_t bufSize) {
+		uint16_t align = frameAlignment();
+		if (_position >= _length || !align) return 0;
+		uint32_t left = (_length - _position + _samples_per_block - 1) / _samples_per_block;
+		uint32_t frames = bufSize / align;
+		return ((frames < left) ? frames : left) * align;
+	}
+
+	/* Moves _position on past numRead bytes just read: a short IMA
+	 * ADPCM block at the end of the data still counts as a whole one
+	 */
+	void advance(uint32_t numRead) {
+		uint16_t align = frameAlignment();
+		if (_position == kUnknownPosition || !align) return;
+		uint32_t frames = (_samples_per_block > 1) ? (numRead + align - 1) / align
+			: numRead / align;
+		_position += frames * _samples_per_block;
+		if (_position > _length) _position = _length;
+	}
 	
 	WavFormat _format;
-	FileWrapper* _file;
-	uint32_t _position; // file position in samples
+	FileType* _file;
+	uint32_t _position; // next sample read() gets, or kUnknownPosition
 	uint32_t _length;   // file length in samples
 	uint32_t _data_offset; // wav data offset in bytes
 	uint32_t _file_size; // file size in bytes	
+	uint32_t _jaw_offset; // jaw track data offset in bytes
+	uint32_t _jaw_frames; // jaw track length in frames
+	uint16_t _jaw_rate;   // jaw track frames per second
+	uint16_t _samples_per_block; // 1 for PCM
+	uint32_t _loop_start; // loop start in samples
+	uint32_t _loop_end;   // sample after the loop, 0 if none
 };
 
+typedef BasicWavLoader<FileWrapper> WavLoader;
+
 #endif // WAVLOADER_H
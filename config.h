@@ -20,6 +20,13 @@
 //#include "graphics/noScleraEye.h" // Large iris, no sclera -OR-
 //#include "graphics/goatEye.h"     // Horizontal pupil goat/Krampus eye -OR-
 //#include "graphics/newtEye.h"     // Eye of newt
+// -OR- several eyes packed by tools/eyepack.cpp, switched while running:
+//#include "graphics/packedEyes.h"  // As shipped: default, dragon
+
+#ifdef PACKED_EYES         // Which packed eye (index in the eyepack list)
+  #define EYE_STYLE_IDLE    0 // is shown while quiet, and
+  #define EYE_STYLE_PLAYING 1 // while a clip plays
+#endif
 
 // Optional: enable this line for startup logo (screen test/orient):
 #if !defined ADAFRUIT_HALLOWING     // Hallowing can't always fit logo+eye
@@ -59,6 +66,27 @@ eyeInfo_t eyeInfo[] = {
   #define DISPLAY_RESET     8    // Reset pin for ALL displays
 #endif
 
+// M0 & M4 boards with a spare SERCOM per extra eye: if EYE_SPI_BUSES is
+// defined, each eye's screen gets an SPI bus (and DMA channel) of its own
+// rather than all of them taking turns on the main one, and their frames
+// are rendered a line at a time each so all the transfers run together.
+// This table then needs ONE LINE PER EYE, in eyeInfo[] order: the SPIClass
+// and SERCOM for the bus, a data/command pin for that screen alone (DC
+// can't be shared once the buses run at the same time), and the SCK and
+// MOSI pins with their pinPeripheral() mux, or -1 if the core sets them.
+// Which SERCOMs & pins are free depends on the board -- see Adafruit's
+// "Using ATSAMD21 SERCOM for more SPI, I2C and Serial ports" guide.
+// Example for two eyes on a Feather M0, the second on SERCOM1 (MOSI 11,
+// SCK 13) with its DC on pin 5:
+//#define EYE_SPI_BUSES
+#ifdef EYE_SPI_BUSES
+  SPIClass eyeSPI1(&sercom1, 12, 13, 11, SPI_PAD_0_SCK_1, SERCOM_RX_PAD_3);
+  eyeBus_t eyeBus[] = {
+    { &SPI,     &PERIPH_SPI, DISPLAY_DC, -1, -1, PIO_SERCOM, PIO_SERCOM },
+    { &eyeSPI1, &sercom1,    5,          13, 11, PIO_SERCOM, PIO_SERCOM },
+  };
+#endif
+
 #if defined(_ADAFRUIT_ST7735H_) || defined(_ADAFRUIT_ST77XXH_)
   #define SPI_FREQ 24000000    // TFT: use max SPI (clips to 12 MHz on M0)
 #else // OLED
@@ -69,6 +97,120 @@ eyeInfo_t eyeInfo[] = {
   #endif
 #endif
 
+// If DELTA_RENDER is defined, drawEye() remembers what was last sent to
+// each screen and only recomputes & transmits the band of scanlines that
+// changed -- nothing at all while the eye is parked between moves.
+// Comment this out to push the full frame every time.
+#define DELTA_RENDER
+
+// SAMD boards: number of scanline buffers in the DMA ring (2 or more).
+// More lines let the renderer run further ahead of the SPI transfer; the
+// FPS printout includes the cycles per frame spent waiting on a full
+// ring, to help tune this against RAM use (256 bytes per line).
+#define DMA_LINES 4
+
+// TFT on SAMD boards: if COLOR_12BIT is defined, the screen is switched to
+// its 12-bit color mode and pixels go out as RGB444, 3 bytes for every 2,
+// so a frame is a quarter less SPI traffic.  RGB565 drops its low bits on
+// the way, invisible for a dim eye socket but some banding in smooth
+// gradients.  (The OLED has no mode below 16 bits, and Teensy's FIFO path
+// sends 16-bit words, so there this is ignored.)
+//#define COLOR_12BIT
+
+// EYE_RAM_TABLES is how many bytes of RAM the renderer may spend on copies
+// of the iris map and polar table, which it reads for every pixel of the
+// iris, so those reads skip the flash wait states.  The iris map is copied
+// first, then polar if there's room left; whatever doesn't fit is read
+// from flash as usual.  The standard eye needs 45K for both, the dragon
+// 130K.  Set by default on boards with 192K of RAM or more (half of it);
+// the M0's 32K has no room for either.
+#if defined(__SAMD51__) && defined(HSRAM_SIZE)        // M4: 192K or 256K
+  #define EYE_RAM_TABLES (HSRAM_SIZE / 2)
+#elif defined(__MK64FX512__) || defined(__MK66FX1M0__) // Teensy 3.5/3.6
+  #define EYE_RAM_TABLES 131072
+#endif
+
+// If PROFILE is defined, the renderer, audio interrupts, sound refill and
+// jaw servo count the CPU cycles they take (see Profile.h).  Send a 'p'
+// over serial for a one-line summary of everything since the last one.
+// Costs a little time per stage and about 600 bytes of RAM.
+//#define PROFILE
+
+// Displays are switched off and the CPU sleeps between interrupts once the
+// motion sensor hasn't tripped for this many milliseconds.
+#define IDLE_TIMEOUT 3500
+
+// AUDIO SETTINGS ----------------------------------------------------------
+
+// If AUDIO_DMA is defined, TC4 paces a DMA channel feeding the DAC from a
+// double buffer, and the CPU only gets involved once per AUDIO_BLOCK
+// samples to refill half of it.  Comment out to fall back on one TC4
+// interrupt (renderSample()) per sample.  AUDIO_BLOCK is also how often
+// the jaw envelope is updated.
+#define AUDIO_DMA
+#define AUDIO_BLOCK 256
+
+// The DAC always runs at AUDIO_RATE; clips recorded at other rates (8 kHz
+// and 11.025 kHz ones take far less flash) are converted on the fly, with
+// AUDIO_TAPS 2 for linear interpolation or 4 for the smoother cubic.
+// SOUND_PITCH below 1.0 plays every clip lower and slower (0.7 makes a
+// fine demon), above 1.0 higher and faster.
+#define AUDIO_RATE  22050
+#define AUDIO_TAPS      4
+#define SOUND_PITCH   1.0
+
+// Filling the sound stream from flash is done from the main loop, between
+// eyes, for up to AUDIO_REFILL_BUDGET microseconds per frame -- unless
+// fewer than AUDIO_REFILL_WATERMARK blocks are still queued, in which case
+// it keeps going until the stream's full.
+#define AUDIO_REFILL_BUDGET    1000
+#define AUDIO_REFILL_WATERMARK    1
+
+// The jaw servo follows the sound's loudness, smoothed per AUDIO_BLOCK:
+// each block the level moves 1/2^JAW_ATTACK of the way up towards a louder
+// block, or 1/2^JAW_RELEASE of the way down.  Bigger is slower.
+#define JAW_ATTACK  1
+#define JAW_RELEASE 3
+
+// Every .wav file in SOUND_DIR (up to SOUND_CLIPS of them) is loaded into a
+// sound bank at startup, keeping the first SOUND_INTRO_BYTES of each clip
+// in RAM so a trigger can start any of them without waiting on the flash.
+// Jaw tracks share SOUND_JAW_BYTES.  The bank costs about
+// SOUND_CLIPS * SOUND_INTRO_BYTES + SOUND_JAW_BYTES of the M0's 32K RAM.
+// Clips play round-robin, or in random order if SOUND_RANDOM is defined.
+#define SOUND_DIR         "/"
+#define SOUND_CLIPS       4
+#define SOUND_INTRO_BYTES 2048
+#define SOUND_JAW_BYTES   1024
+//#define SOUND_RANDOM
+
+// With SOUND_RAW_FLASH defined, clips that aren't fragmented on the flash
+// are found by address at startup and streamed with raw flash reads, no
+// FatFs in the way (fragmented ones still go through FatFs).  Don't write
+// to the flash over USB while the sketch is running.
+#define SOUND_RAW_FLASH
+
+// FAST_BOOT gets the eyes going sooner.  setup() only waits for the serial
+// monitor (and shows the logo) when USB is plugged into a computer, loads
+// just the first clip, and leaves the rest of the bank to the main loop,
+// one clip per frame; the directory is scanned quietly (send 'l' over
+// serial for the listing).  Each clip's header and flash extent are kept
+// in SOUND_INDEX, rewritten whenever the clips change, so a later boot
+// with the same files doesn't parse or locate any of them.  Files are
+// told apart by name and size only -- delete SOUND_INDEX after replacing
+// a clip with a different one of exactly the same size.
+#define FAST_BOOT
+#define SOUND_INDEX "/SOUNDS.IDX"
+
+// With SOUND_LOOP defined, a clip with loop points (a 'smpl' chunk, as
+// most sample editors write) repeats its loop for as long as the motion
+// sensor stays tripped, then plays on past it to the end: breathing or
+// chanting that carries on while someone's there.  The first
+// SOUND_LOOP_BLOCKS * 2K of the loop are kept in RAM so going round never
+// waits on the flash.
+//#define SOUND_LOOP
+#define SOUND_LOOP_BLOCKS 1
+
 // INPUT SETTINGS (for controlling eye motion) -----------------------------
 
 // JOYSTICK_X_PIN and JOYSTICK_Y_PIN specify analog input pins for manually
@@ -0,0 +1,46 @@
+// Packed eye format, as written by tools/eyepack.cpp.  Include a file it
+// generated (e.g. graphics/packedEyes.h) in config.h in place of a single
+// eye header to keep several eyes in flash and switch between them while
+// running -- see EYE_STYLE_IDLE in config.h.
+//
+// Compared to the plain headers:
+//  - sclera[] and iris[] hold 8-bit indices into a 256-color palette per
+//    image (colors are merged if there are more than that),
+//  - identical sclera rows are stored once (a solid sclera is one row),
+//  - polar[] and upper[]/lower[] maps shared by several eyes are stored
+//    once (with SYMMETRICAL_EYELID, all five stock eyes share their lids).
+// Pixels cost one palette lookup more in drawEye(); everything else reads
+// the same as before.
+
+#ifndef _PACKED_EYE_H_
+#define _PACKED_EYE_H_
+
+typedef struct {
+  uint16_t        scleraWidth, scleraHeight;
+  uint16_t        irisMapWidth, irisMapHeight;
+  uint16_t        irisWidth, irisHeight;       // Size of polar[] square
+  uint16_t        irisMin, irisMax;            // Iris scale range
+  const uint16_t *scleraPalette;               // 256 RGB565 colors
+  const uint8_t  *scleraRows;                  // Row in scleraPixels per Y
+  const uint8_t  *scleraPixels;                // Palette indices
+  const uint16_t *irisPalette;                 // 256 RGB565 colors
+  const uint8_t  *irisPixels;                  // Palette indices
+  const uint16_t *polar;                       // irisHeight x irisWidth
+  const uint8_t  *upper;                       // SCREEN_HEIGHT x SCREEN_WIDTH
+  const uint8_t  *lower;
+} packedEye;
+
+extern const packedEye *eyeStyle; // One being drawn, set in the sketch
+
+#define SCREEN_WIDTH    128
+#define SCREEN_HEIGHT   128
+#define SCLERA_WIDTH    (eyeStyle->scleraWidth)
+#define SCLERA_HEIGHT   (eyeStyle->scleraHeight)
+#define IRIS_MAP_WIDTH  (eyeStyle->irisMapWidth)
+#define IRIS_MAP_HEIGHT (eyeStyle->irisMapHeight)
+#define IRIS_WIDTH      (eyeStyle->irisWidth)
+#define IRIS_HEIGHT     (eyeStyle->irisHeight)
+#define IRIS_MIN        (eyeStyle->irisMin)
+#define IRIS_MAX        (eyeStyle->irisMax)
+
+#endif // _PACKED_EYE_H_
@@ -0,0 +1,278 @@
+/*
+ * bench -- host timings for the eye renderer and the sound stream
+ *
+ * Host-side tool.  Build from this directory with e.g.
+ *	g++ -std=c++11 -O2 -DUSE_POSIX -DSYMMETRICAL_EYELID -I.. -o bench bench.cpp ../WavLoader.cpp
+ * which benchmarks graphics/defaultEye.h; add
+ *	-DEYE_HEADER='"graphics/dragonEye.h"'
+ * (any eye header, or graphics/packedEyes.h for every eye in it) to time
+ * another.  Leave out -DSYMMETRICAL_EYELID for the caruncle lids.
+ *
+ * Usage: bench [clip.wav [seconds per test]]
+ *	clip defaults to ../HelloThere_DS.wav, seconds to 1
+ *
+ * The render tests run the same eyeLines() kernel as drawEye() (Eye.h)
+ * into a line buffer instead of the display, so they measure pixel work
+ * only: no SPI, DMA waits or (with DELTA_RENDER) skipped lines.  The sound
+ * tests stream the clip through AudioSamplerStream from a PosixFileWrapper
+ * for a few ring shapes, straight through and with a seek every read,
+ * then through AudioResampler to the DAC rate (flagging a resampler that
+ * doesn't stop at the end of the clip).
+ * Host numbers are for comparing one build against another, not for the
+ * frame rate on a board.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#ifndef EYE_HEADER
+#define EYE_HEADER "graphics/defaultEye.h"
+#endif
+#include EYE_HEADER
+
+#if !defined(IRIS_MIN) // As config.h
+#define IRIS_MIN 120
+#endif
+#if !defined(IRIS_MAX)
+#define IRIS_MAX 820
+#endif
+#if defined(PACKED_EYES) && !defined(EYE_STYLE_IDLE)
+#define EYE_STYLE_IDLE 0
+#endif
+
+#include "Eye.h"
+#include "AudioStream.h"
+
+using namespace Unsaturated;
+
+namespace {
+
+	typedef std::chrono::steady_clock Clock;
+
+	double seconds = 1.0; /* Length of each test */
+
+	eyeTables tables; /* drawEye() keeps one per SPI bus */
+
+	double since(Clock::time_point start) {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	/* Stands in for the sketch's DMA ring: same byte swap into a line
+	 * buffer, plus a checksum so the work isn't optimized away
+	 */
+	struct BenchSink {
+		uint16_t  line[SCREEN_WIDTH];
+		uint16_t* ptr;
+		uint32_t  sum;
+
+		BenchSink() : ptr(line), sum(0) { }
+		void begin(uint8_t) { ptr = line; }
+		void pixel(uint16_t p) { *ptr++ = __builtin_bswap16(p); }
+		void black(uint8_t n)  { memset(ptr, 0, n * sizeof *ptr); ptr += n; }
+		void end(void) {
+			for (int x = 0; x < SCREEN_WIDTH; x++) sum = sum * 31 + line[x];
+		}
+	};
+
+	/* Same mapping as frame(): iris size 0-1023 to iScale */
+	uint32_t irisScale(uint32_t v) {
+		return ((IRIS_MAP_HEIGHT + 1) * 1024) /
+			(1024 - (v * (IRIS_MAP_HEIGHT - 1) / IRIS_MAP_HEIGHT));
+	}
+
+	/* What a test varies from frame to frame */
+	enum RenderTest {
+		kOpen,       // Eye still and centered, lids open
+		kBlink,      // Lids closing and opening
+		kIris,       // Iris scale sweeping IRIS_MIN to IRIS_MAX and back
+		kLookAround  // Random eye position each frame
+	};
+
+	void benchRender(const char* name, RenderTest test) {
+		BenchSink sink;
+		uint32_t frames = 0, mid = irisScale((IRIS_MIN + IRIS_MAX) / 2);
+		uint8_t cx = (SCLERA_WIDTH - SCREEN_WIDTH) / 2,
+		        cy = (SCLERA_HEIGHT - SCREEN_HEIGHT) / 2;
+		srand(1);
+		Clock::time_point start = Clock::now();
+		double t;
+		do {
+			for (int i = 0; i < 64; i++, frames++) {
+				uint32_t iScale = mid, phase = frames & 255;
+				uint8_t  sx = cx, sy = cy, uT = 0, lT = 0;
+				uint32_t tri = (phase < 128) ? phase : 255 - phase; // 0-127-0
+				switch (test) {
+				case kOpen:
+					break;
+				case kBlink:
+					uT = lT = tri * 2;
+					break;
+				case kIris:
+					iScale = irisScale(IRIS_MIN + tri * (IRIS_MAX - IRIS_MIN) / 127);
+					break;
+				case kLookAround:
+					sx = rand() % (SCLERA_WIDTH - SCREEN_WIDTH + 1);
+					sy = rand() % (SCLERA_HEIGHT - SCREEN_HEIGHT + 1);
+					break;
+				}
+				lidSpans(&tables, uT, lT, NULL, NULL);
+				irisRows(&tables, iScale);
+				eyeLines(sink, &tables, sx, sy, uT, lT, 0, SCREEN_HEIGHT);
+			}
+		} while ((t = since(start)) < seconds);
+		printf("  %-12s %8.0f frames/s %8.2f Mpixel/s  (%08x)\n", name,
+					 frames / t, frames * (double)(SCREEN_WIDTH * SCREEN_HEIGHT) / t / 1e6,
+					 sink.sum);
+	}
+
+	void benchEye(const char* name) {
+		printf("%s (%dx%d sclera, %dx%d iris map)\n", name,
+					 (int)SCLERA_WIDTH, (int)SCLERA_HEIGHT,
+					 (int)IRIS_MAP_WIDTH, (int)IRIS_MAP_HEIGHT);
+		lidInit();
+		eyeRamInit();
+		eyeTablesInit(&tables);
+		benchRender("open", kOpen);
+		benchRender("blink", kBlink);
+		benchRender("iris", kIris);
+		benchRender("look around", kLookAround);
+	}
+
+	const unsigned kReadSize = 256;   /* Samples per read, as AUDIO_BLOCK */
+	const uint32_t kAudioRate = 22050; /* DAC rate, as AUDIO_RATE */
+
+	/* Reads the whole clip kReadSize samples at a time, calling prime()
+	 * after each read like audioService() does (and again whenever a read
+	 * comes up short), optionally seeking somewhere random before every
+	 * read.  Returns samples read per second.
+	 */
+	template <typename StreamType>
+	double streamRate(StreamType& stream, uint32_t length, bool seeks) {
+		int16_t buf[kReadSize];
+		uint32_t samples = 0;
+		srand(1);
+		Clock::time_point start = Clock::now();
+		double t;
+		do {
+			stream.set_sample_index(0);
+			for (uint32_t done = 0; done < length; ) {
+				if (seeks) stream.set_sample_index(rand() % length);
+				uint32_t got = 0;
+				while (got < kReadSize) {
+					int n = stream.read(buf + got, kReadSize - got);
+					got += n;
+					if (!n && !stream.prime(2)) break; // End of the clip
+				}
+				stream.prime();
+				if (!got) break;
+				samples += got;
+				done += got;
+			}
+		} while ((t = since(start)) < seconds);
+		return samples / t;
+	}
+
+	template <int BlockSize, int NumBlocks>
+	void benchStream(const char* clip) {
+		typedef AudioSamplerStream<int16_t, BlockSize, NumBlocks, 0, 0, 0,
+															 PosixFileWrapper> StreamType;
+		static StreamType stream;
+		stream.setUnderrunHold(false); // streamRate() primes on a short read
+		PosixFileWrapper file(clip, "rb");
+		BasicWavLoader<PosixFileWrapper> wav;
+		uint32_t length = wav.open(&file) ? wav.numSamples() : 0;
+		wav.close();
+		if (!length || stream.load(&file) != AudioSamplerError::NoErr) {
+			printf("  can't load %s\n", clip);
+			return;
+		}
+		double straight = streamRate(stream, length, false);
+		double seeking = streamRate(stream, length, true);
+		printf("  %5d x %d %10.2f Msample/s %10.0f seeks/s\n", BlockSize, NumBlocks,
+					 straight / 1e6, seeking / kReadSize);
+		file.close();
+	}
+
+	/* Plays the clip to the end through an AudioResampler to the DAC
+	 * rate, kReadSize samples at a time, and checks that it then stays
+	 * ended: renderSample() stops playback on the first read that comes
+	 * up short, one sample at a time.
+	 */
+	template <int Taps>
+	void benchResample(const char* clip) {
+		typedef AudioSamplerStream<int16_t, 2048, 3, 0, 0, 0,
+															 PosixFileWrapper> StreamType;
+		static StreamType stream;
+		static AudioResampler<StreamType, int16_t, Taps, kReadSize> resampler(&stream);
+		stream.setUnderrunHold(false);
+		PosixFileWrapper file(clip, "rb");
+		BasicWavLoader<PosixFileWrapper> wav;
+		uint32_t rate = wav.open(&file) ? wav.sampleRate() : 0;
+		uint32_t most = rate ? /* Output the clip can make, and some */
+			(uint32_t)((uint64_t)wav.numSamples() * kAudioRate / rate) + 2 * kReadSize : 0;
+		wav.close();
+		if (!rate || stream.load(&file) != AudioSamplerError::NoErr) {
+			printf("  can't load %s\n", clip);
+			return;
+		}
+		resampler.setRates(rate, kAudioRate);
+		int16_t buf[kReadSize];
+		uint32_t samples = 0, extra = 0;
+		Clock::time_point start = Clock::now();
+		double t;
+		do {
+			stream.set_sample_index(0);
+			resampler.reset();
+			for (uint32_t done = 0; ; ) {
+				uint32_t got = 0;
+				while (got < kReadSize) {
+					int n = resampler.read(buf + got, kReadSize - got);
+					got += n;
+					if (!n && !stream.prime(2)) break;
+				}
+				stream.prime();
+				samples += got;
+				done += got;
+				if (got < kReadSize) break;
+				if (done > most) { extra = 1; break; } // Never came up short
+			}
+			for (int i = 0; i < 16; i++) extra += resampler.read(buf, 1);
+		} while (!extra && (t = since(start)) < seconds);
+		if (extra) t = since(start);
+		printf("  %d taps %10.2f Msample/s%s\n", Taps, samples / t / 1e6,
+					 extra ? "  (read past the end!)" : "");
+		file.close();
+	}
+
+}
+
+
+int main(int argc, char* argv[]) {
+	const char* clip = (argc > 1) ? argv[1] : "../HelloThere_DS.wav";
+	if (argc > 2) seconds = atof(argv[2]);
+
+	printf("Render, eyeLines() into a line buffer\n");
+#ifdef PACKED_EYES
+	for (int e = 0; e < PACKED_EYES; e++) {
+		char name[32];
+		snprintf(name, sizeof(name), "packed eye %d", e);
+		eyeStyle = &packedEyes[e];
+		benchEye(name);
+	}
+#else
+	benchEye(EYE_HEADER);
+#endif
+
+	printf("\nStream, %s (block bytes x blocks)\n", clip);
+	benchStream<512, 4>(clip);
+	benchStream<1024, 4>(clip);
+	benchStream<2048, 3>(clip);
+	benchStream<4096, 2>(clip);
+
+	printf("\nResample to %u Hz, %s\n", (unsigned)kAudioRate, clip);
+	benchResample<2>(clip);
+	benchResample<4>(clip);
+	return 0;
+}
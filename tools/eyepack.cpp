@@ -0,0 +1,418 @@
+/*
+ * eyepack -- converts the stock eye headers to the packed format
+ *
+ * Host-side tool.  Build from this directory with e.g.
+ *	g++ -std=c++11 -O2 -DSYMMETRICAL_EYELID -o eyepack eyepack.cpp
+ * (leave out -DSYMMETRICAL_EYELID to get the caruncle lids, as for
+ * config.h).  Compiling takes a while, all five eye headers go in.
+ *
+ * Usage: eyepack eye [eye ...] > ../graphics/packedEyes.h
+ *	where each eye is one of default, dragon, noSclera, goat, newt
+ *
+ * Writes one header holding the listed eyes in the packedEye format (see
+ * graphics/packedEye.h), in that order: packedEyes[0] is the first one.
+ * Images with more than 256 colors are median-cut down to 256, maps that
+ * are the same in several eyes are written once.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+	/* Everything eyepack needs from one eye header */
+	struct EyeSource {
+		const char*     name;
+		int             scleraWidth, scleraHeight;
+		int             irisMapWidth, irisMapHeight;
+		int             irisWidth, irisHeight;
+		int             irisMin, irisMax;
+		const uint16_t* sclera;
+		const uint16_t* iris;
+		const uint16_t* polar;
+		const uint8_t*  upper;
+		const uint8_t*  lower;
+	};
+
+}
+
+// Each header defines the same names, so each goes in its own namespace
+// and its #defines are picked up, then cleared for the next one.  Eyes
+// that don't set IRIS_MIN/MAX get config.h's defaults.
+#define EYE_SOURCE(label) { label, SCLERA_WIDTH, SCLERA_HEIGHT, \
+	IRIS_MAP_WIDTH, IRIS_MAP_HEIGHT, IRIS_WIDTH, IRIS_HEIGHT, \
+	EYE_IRIS_MIN, EYE_IRIS_MAX, &sclera[0][0], &iris[0][0], &polar[0][0], \
+	&upper[0][0], &lower[0][0] }
+#define EYE_IRIS_MIN_DEFAULT 120
+#define EYE_IRIS_MAX_DEFAULT 820
+
+namespace defaultEye {
+#include "../graphics/defaultEye.h"
+#ifdef IRIS_MIN
+	const int EYE_IRIS_MIN = IRIS_MIN, EYE_IRIS_MAX = IRIS_MAX;
+#else
+	const int EYE_IRIS_MIN = EYE_IRIS_MIN_DEFAULT, EYE_IRIS_MAX = EYE_IRIS_MAX_DEFAULT;
+#endif
+	const EyeSource source = EYE_SOURCE("default");
+}
+#undef SCLERA_WIDTH
+#undef SCLERA_HEIGHT
+#undef IRIS_MAP_WIDTH
+#undef IRIS_MAP_HEIGHT
+#undef SCREEN_WIDTH
+#undef SCREEN_HEIGHT
+#undef IRIS_WIDTH
+#undef IRIS_HEIGHT
+#undef IRIS_MIN
+#undef IRIS_MAX
+
+namespace dragonEye {
+#include "../graphics/dragonEye.h"
+#ifdef IRIS_MIN
+	const int EYE_IRIS_MIN = IRIS_MIN, EYE_IRIS_MAX = IRIS_MAX;
+#else
+	const int EYE_IRIS_MIN = EYE_IRIS_MIN_DEFAULT, EYE_IRIS_MAX = EYE_IRIS_MAX_DEFAULT;
+#endif
+	const EyeSource source = EYE_SOURCE("dragon");
+}
+#undef SCLERA_WIDTH
+#undef SCLERA_HEIGHT
+#undef IRIS_MAP_WIDTH
+#undef IRIS_MAP_HEIGHT
+#undef SCREEN_WIDTH
+#undef SCREEN_HEIGHT
+#undef IRIS_WIDTH
+#undef IRIS_HEIGHT
+#undef IRIS_MIN
+#undef IRIS_MAX
+
+namespace noScleraEye {
+#include "../graphics/noScleraEye.h"
+#ifdef IRIS_MIN
+	const int EYE_IRIS_MIN = IRIS_MIN, EYE_IRIS_MAX = IRIS_MAX;
+#else
+	const int EYE_IRIS_MIN = EYE_IRIS_MIN_DEFAULT, EYE_IRIS_MAX = EYE_IRIS_MAX_DEFAULT;
+#endif
+	const EyeSource source = EYE_SOURCE("noSclera");
+}
+#undef SCLERA_WIDTH
+#undef SCLERA_HEIGHT
+#undef IRIS_MAP_WIDTH
+#undef IRIS_MAP_HEIGHT
+#undef SCREEN_WIDTH
+#undef SCREEN_HEIGHT
+#undef IRIS_WIDTH
+#undef IRIS_HEIGHT
+#undef IRIS_MIN
+#undef IRIS_MAX
+
+namespace goatEye {
+#include "../graphics/goatEye.h"
+#ifdef IRIS_MIN
+	const int EYE_IRIS_MIN = IRIS_MIN, EYE_IRIS_MAX = IRIS_MAX;
+#else
+	const int EYE_IRIS_MIN = EYE_IRIS_MIN_DEFAULT, EYE_IRIS_MAX = EYE_IRIS_MAX_DEFAULT;
+#endif
+	const EyeSource source = EYE_SOURCE("goat");
+}
+#undef SCLERA_WIDTH
+#undef SCLERA_HEIGHT
+#undef IRIS_MAP_WIDTH
+#undef IRIS_MAP_HEIGHT
+#undef SCREEN_WIDTH
+#undef SCREEN_HEIGHT
+#undef IRIS_WIDTH
+#undef IRIS_HEIGHT
+#undef IRIS_MIN
+#undef IRIS_MAX
+
+namespace newtEye {
+#include "../graphics/newtEye.h"
+#ifdef IRIS_MIN
+	const int EYE_IRIS_MIN = IRIS_MIN, EYE_IRIS_MAX = IRIS_MAX;
+#else
+	const int EYE_IRIS_MIN = EYE_IRIS_MIN_DEFAULT, EYE_IRIS_MAX = EYE_IRIS_MAX_DEFAULT;
+#endif
+	const EyeSource source = EYE_SOURCE("newt");
+}
+
+namespace {
+
+	const int SCREEN_SIZE = 128;
+
+	const EyeSource* const SOURCES[] = {
+		&defaultEye::source, &dragonEye::source, &noScleraEye::source,
+		&goatEye::source, &newtEye::source
+	};
+
+	/* RGB565 <-> 8 bits per channel, for working out color distances */
+	struct Color {
+		int c[3];
+	};
+
+	Color unpack(uint16_t p) {
+		Color c;
+		c.c[0] = ((p >> 11) & 0x1F) * 255 / 31;
+		c.c[1] = ((p >> 5) & 0x3F) * 255 / 63;
+		c.c[2] = (p & 0x1F) * 255 / 31;
+		return c;
+	}
+
+	uint16_t pack(const Color& c) {
+		return ((c.c[0] * 31 + 127) / 255) << 11 |
+			((c.c[1] * 63 + 127) / 255) << 5 |
+			((c.c[2] * 31 + 127) / 255);
+	}
+
+	int distance(const Color& a, const Color& b) {
+		int d = 0;
+		for (int i = 0; i < 3; i++) d += (a.c[i] - b.c[i]) * (a.c[i] - b.c[i]);
+		return d;
+	}
+
+	struct Entry {
+		uint16_t color;
+		long     count;
+	};
+
+	/* Median cut: split the box with the widest channel at its weighted
+	 * median until there are 256, each box's mean becomes a color
+	 */
+	std::vector<uint16_t> medianCut(std::vector<Entry> colors) {
+		typedef std::pair<size_t, size_t> Box; // [first, last) in colors
+		std::vector<Box> boxes(1, Box(0, colors.size()));
+		while (boxes.size() < 256) {
+			int best = -1, bestChannel = 0, bestRange = 0;
+			for (size_t b = 0; b < boxes.size(); b++) {
+				if (boxes[b].second - boxes[b].first < 2) continue;
+				for (int ch = 0; ch < 3; ch++) {
+					int lo = 255, hi = 0;
+					for (size_t i = boxes[b].first; i < boxes[b].second; i++) {
+						int v = unpack(colors[i].color).c[ch];
+						lo = std::min(lo, v);
+						hi = std::max(hi, v);
+					}
+					if (hi - lo > bestRange) {
+						best = b;
+						bestChannel = ch;
+						bestRange = hi - lo;
+					}
+				}
+			}
+			if (best < 0) break; // Nothing left to split
+			Box box = boxes[best];
+			std::sort(colors.begin() + box.first, colors.begin() + box.second,
+								[bestChannel](const Entry& a, const Entry& b) {
+									return unpack(a.color).c[bestChannel] < unpack(b.color).c[bestChannel];
+								});
+			long total = 0, half = 0;
+			for (size_t i = box.first; i < box.second; i++) total += colors[i].count;
+			size_t split = box.first + 1;
+			for (size_t i = box.first; i < box.second - 1; i++) {
+				half += colors[i].count;
+				split = i + 1;
+				if (half * 2 >= total) break;
+			}
+			boxes[best] = Box(box.first, split);
+			boxes.push_back(Box(split, box.second));
+		}
+
+		std::vector<uint16_t> palette;
+		for (size_t b = 0; b < boxes.size(); b++) {
+			double sum[3] = { 0, 0, 0 };
+			long total = 0;
+			for (size_t i = boxes[b].first; i < boxes[b].second; i++) {
+				Color c = unpack(colors[i].color);
+				for (int ch = 0; ch < 3; ch++) sum[ch] += (double)c.c[ch] * colors[i].count;
+				total += colors[i].count;
+			}
+			Color mean;
+			for (int ch = 0; ch < 3; ch++) mean.c[ch] = (int)(sum[ch] / total + 0.5);
+			palette.push_back(pack(mean));
+		}
+		return palette;
+	}
+
+	/* An image as palette plus one index per pixel */
+	struct Indexed {
+		std::vector<uint16_t> palette;
+		std::vector<uint8_t>  pixels;
+		int                   merged; // Colors that didn't fit, 0 if exact
+	};
+
+	Indexed indexImage(const uint16_t* image, size_t size) {
+		std::map<uint16_t, long> histogram;
+		for (size_t i = 0; i < size; i++) histogram[image[i]]++;
+		std::vector<Entry> colors;
+		for (std::map<uint16_t, long>::const_iterator it = histogram.begin();
+				 it != histogram.end(); ++it) {
+			Entry e = { it->first, it->second };
+			colors.push_back(e);
+		}
+
+		Indexed result;
+		result.merged = 0;
+		if (colors.size() <= 256) {
+			for (size_t i = 0; i < colors.size(); i++) result.palette.push_back(colors[i].color);
+		} else {
+			result.palette = medianCut(colors);
+			result.merged = colors.size();
+		}
+		std::map<uint16_t, uint8_t> lookup;
+		for (size_t i = 0; i < colors.size(); i++) {
+			Color c = unpack(colors[i].color);
+			int best = 0, bestDistance = -1;
+			for (size_t p = 0; p < result.palette.size(); p++) {
+				int d = (result.palette[p] == colors[i].color) ? 0 :
+					distance(c, unpack(result.palette[p])) + 1;
+				if (bestDistance < 0 || d < bestDistance) {
+					best = p;
+					bestDistance = d;
+				}
+			}
+			lookup[colors[i].color] = best;
+		}
+		result.palette.resize(256, 0);
+		for (size_t i = 0; i < size; i++) result.pixels.push_back(lookup[image[i]]);
+		return result;
+	}
+
+	void writeArray(const char* type, const std::string& name,
+									const uint8_t* data, size_t size) {
+		printf("const %s %s[%zu] = {", type, name.c_str(), size);
+		for (size_t i = 0; i < size; i++) {
+			printf("%s0x%02X%s", (i % 16) ? " " : "\n  ", data[i], (i < size - 1) ? "," : "");
+		}
+		printf("\n};\n\n");
+	}
+
+	void writeArray(const char* type, const std::string& name,
+									const uint16_t* data, size_t size) {
+		printf("const %s %s[%zu] = {", type, name.c_str(), size);
+		for (size_t i = 0; i < size; i++) {
+			printf("%s0x%04X%s", (i % 8) ? " " : "\n  ", data[i], (i < size - 1) ? "," : "");
+		}
+		printf("\n};\n\n");
+	}
+
+	/* Maps shared between eyes are written once: returns the name of an
+	 * identical map already written, or writes this one under name
+	 */
+	struct Shared {
+		std::vector<std::pair<std::vector<uint8_t>, std::string> > written;
+
+		template <typename T>
+		std::string write(const char* type, const std::string& name,
+											const T* data, size_t size) {
+			std::vector<uint8_t> bytes((const uint8_t*)data, (const uint8_t*)(data + size));
+			for (size_t i = 0; i < written.size(); i++) {
+				if (written[i].first == bytes) return written[i].second;
+			}
+			writeArray(type, name, data, size);
+			written.push_back(std::make_pair(bytes, name));
+			return name;
+		}
+	};
+
+}
+
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s eye [eye ...] > packedEyes.h\n"
+						"  eyes: default dragon noSclera goat newt\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<const EyeSource*> eyes;
+	for (int a = 1; a < argc; a++) {
+		const EyeSource* found = NULL;
+		for (size_t s = 0; s < sizeof(SOURCES) / sizeof(SOURCES[0]); s++) {
+			if (!strcmp(argv[a], SOURCES[s]->name)) found = SOURCES[s];
+		}
+		if (!found) {
+			fprintf(stderr, "Unknown eye '%s'\n", argv[a]);
+			return 1;
+		}
+		eyes.push_back(found);
+	}
+
+	printf("// Generated by tools/eyepack.cpp --");
+	for (size_t e = 0; e < eyes.size(); e++) printf(" %s", eyes[e]->name);
+#ifdef SYMMETRICAL_EYELID
+	printf(", symmetrical lids");
+#endif
+	printf("\n// Don't edit, regenerate.  Format is in packedEye.h.\n\n");
+	printf("#include \"packedEye.h\"\n\n");
+	printf("#define PACKED_EYES %zu\n\n", eyes.size());
+
+	Shared shared;
+	std::vector<std::string> descriptors;
+	size_t total = 0, raw = 0;
+	for (size_t e = 0; e < eyes.size(); e++) {
+		const EyeSource& src = *eyes[e];
+		std::string name = src.name;
+		char line[512];
+
+		/* Sclera: index it, then store each distinct row once */
+		Indexed sclera = indexImage(src.sclera, src.scleraWidth * src.scleraHeight);
+		std::vector<uint8_t> rows, rowPixels;
+		std::vector<std::vector<uint8_t> > distinct;
+		for (int y = 0; y < src.scleraHeight; y++) {
+			std::vector<uint8_t> row(sclera.pixels.begin() + y * src.scleraWidth,
+															 sclera.pixels.begin() + (y + 1) * src.scleraWidth);
+			size_t r = std::find(distinct.begin(), distinct.end(), row) - distinct.begin();
+			if (r == distinct.size()) {
+				distinct.push_back(row);
+				rowPixels.insert(rowPixels.end(), row.begin(), row.end());
+			}
+			rows.push_back(r);
+		}
+		Indexed iris = indexImage(src.iris, src.irisMapWidth * src.irisMapHeight);
+
+		writeArray("uint16_t", name + "ScleraPalette", &sclera.palette[0], 256);
+		writeArray("uint8_t", name + "ScleraRows", &rows[0], rows.size());
+		writeArray("uint8_t", name + "ScleraPixels", &rowPixels[0], rowPixels.size());
+		writeArray("uint16_t", name + "IrisPalette", &iris.palette[0], 256);
+		writeArray("uint8_t", name + "IrisPixels", &iris.pixels[0], iris.pixels.size());
+		size_t polarSize = src.irisWidth * src.irisHeight,
+		       lidSize = SCREEN_SIZE * SCREEN_SIZE;
+		std::string polar = shared.write("uint16_t", name + "Polar", src.polar, polarSize);
+		std::string upper = shared.write("uint8_t", name + "Upper", src.upper, lidSize);
+		std::string lower = shared.write("uint8_t", name + "Lower", src.lower, lidSize);
+
+		size_t size = 2 * 256 * 2 + rows.size() + rowPixels.size() + iris.pixels.size();
+		if (polar == name + "Polar") size += polarSize * 2;
+		if (upper == name + "Upper") size += lidSize;
+		if (lower == name + "Lower") size += lidSize;
+		total += size;
+		raw += (src.scleraWidth * src.scleraHeight + src.irisMapWidth * src.irisMapHeight +
+						polarSize) * 2 + lidSize * 2;
+		fprintf(stderr, "%s: %zu bytes, %zu sclera rows, colors merged %d sclera / %d iris\n",
+						src.name, size, distinct.size(), sclera.merged, iris.merged);
+
+		snprintf(line, sizeof(line),
+						 "  { %d, %d, %d, %d, %d, %d, %d, %d,\n"
+						 "    %sScleraPalette, %sScleraRows, %sScleraPixels,\n"
+						 "    %sIrisPalette, %sIrisPixels, %s, %s, %s }",
+						 src.scleraWidth, src.scleraHeight, src.irisMapWidth, src.irisMapHeight,
+						 src.irisWidth, src.irisHeight, src.irisMin, src.irisMax,
+						 src.name, src.name, src.name, src.name, src.name,
+						 polar.c_str(), upper.c_str(), lower.c_str());
+		descriptors.push_back(line);
+	}
+
+	printf("const packedEye packedEyes[PACKED_EYES] = {\n");
+	for (size_t e = 0; e < descriptors.size(); e++) {
+		printf("%s%s // %s\n", descriptors[e].c_str(),
+					 (e < descriptors.size() - 1) ? "," : "", eyes[e]->name);
+	}
+	printf("};\n");
+	fprintf(stderr, "Total %zu bytes (%zu unpacked)\n", total, raw);
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * jawtrack -- adds a pre-analyzed jaw servo track to a WAV file
+ *
+ * Host-side tool.  Build from this directory with e.g.
+ *	g++ -std=c++11 -DUSE_POSIX -I.. -o jawtrack jawtrack.cpp ../WavLoader.cpp
+ *
+ * Usage: jawtrack in.wav out.wav [frame rate [attack shift [release shift]]]
+ *
+ * Runs the clip through the same envelope follower and angle curve the
+ * sketch uses at runtime, stepped once per AUDIO_BLOCK samples at
+ * AUDIO_RATE as the DAC feeds it (build with -DAUDIO_BLOCK=... or
+ * -DAUDIO_RATE=... if config.h has been changed), and samples it once a
+ * frame.  Writes a copy of the file with the result in a 'jaw ' chunk
+ * (see JawTrackHeader), replacing any that's already there.  Values are
+ * plain servo angles in degrees, so the track can be hand-tuned afterwards.
+ */
+
+#include "AudioStream.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if !defined(AUDIO_BLOCK) // As config.h
+#define AUDIO_BLOCK 256
+#endif
+#if !defined(AUDIO_RATE)
+#define AUDIO_RATE  22050
+#endif
+
+namespace {
+
+	/* Same curve as jawAngle() in the sketch */
+	uint8_t jawAngle(uint32_t meanSquare) {
+		uint32_t a = ((meanSquare >> 16) * 90) >> 10;
+		a *= (a >> 1) * 10;
+		return (a > 180) ? 180 : a;
+	}
+
+	bool copyBytes(FILE* in, FILE* out, uint32_t size) {
+		char buf[4096];
+		while (size) {
+			size_t n = (size < sizeof(buf)) ? size : sizeof(buf);
+			if (fread(buf, 1, n, in) != n || fwrite(buf, 1, n, out) != n) {
+				return false;
+			}
+			size -= n;
+		}
+		return true;
+	}
+
+	/* Copy every chunk of a RIFF file except any old jaw track, then
+	 * append the new one and patch up the RIFF size
+	 */
+	bool writeWithTrack(const char* inName, const char* outName,
+											const JawTrackHeader& jaw, const std::vector<uint8_t>& track) {
+		FILE* in = fopen(inName, "rb");
+		FILE* out = fopen(outName, "wb");
+		if (!in || !out) {
+			if (in) fclose(in);
+			if (out) fclose(out);
+			return false;
+		}
+
+		bool ok = copyBytes(in, out, 12); /* 'RIFF', size, 'WAVE' */
+		char tag[4];
+		uint32_t size;
+		while (ok && fread(tag, 1, 4, in) == 4 && fread(&size, 4, 1, in) == 1) {
+			uint32_t padded = size + (size & 1);
+			if (!memcmp(tag, "jaw ", 4)) {
+				ok = !fseek(in, padded, SEEK_CUR);
+				continue;
+			}
+			ok = fwrite(tag, 1, 4, out) == 4 && fwrite(&size, 4, 1, out) == 1 &&
+				copyBytes(in, out, padded);
+		}
+
+		if (ok) {
+			size = sizeof(jaw) + track.size();
+			ok = fwrite("jaw ", 1, 4, out) == 4 && fwrite(&size, 4, 1, out) == 1 &&
+				fwrite(&jaw, sizeof(jaw), 1, out) == 1 &&
+				fwrite(track.data(), 1, track.size(), out) == track.size();
+		}
+		if (ok) {
+			uint32_t riffSize = (uint32_t)ftell(out) - 8;
+			ok = !fseek(out, 4, SEEK_SET) && fwrite(&riffSize, 4, 1, out) == 1;
+		}
+
+		fclose(in);
+		ok = !fclose(out) && ok;
+		return ok;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s in.wav out.wav [frame rate [attack shift [release shift]]]\n", argv[0]);
+		return 1;
+	}
+	unsigned int frameRate = (argc > 3) ? atoi(argv[3]) : 60;
+	uint8_t attack = (argc > 4) ? atoi(argv[4]) : 1;
+	uint8_t release = (argc > 5) ? atoi(argv[5]) : 3;
+	if (!frameRate || frameRate > 0xFFFF) {
+		fprintf(stderr, "bad frame rate %u\n", frameRate);
+		return 1;
+	}
+
+	PosixFileWrapper file(argv[1], "rb");
+	WavLoader wav;
+	if (!wav.open(&file)) {
+		fprintf(stderr, "can't open %s as a WAV file\n", argv[1]);
+		return 1;
+	}
+	if (wav.bitsPerSample() != 16 || wav.numChannels() != 1) {
+		fprintf(stderr, "%s: only 16-bit mono is supported\n", argv[1]);
+		return 1;
+	}
+
+	/* Frame n covers samples [n * rate / frameRate, (n+1) * rate / frameRate)
+	 * and block k, an AUDIO_BLOCK of DAC output, the clip samples
+	 * [k * AUDIO_BLOCK * rate / AUDIO_RATE, ...).  Each frame gets the
+	 * level after the last block that finished in it; the short block at
+	 * the end of the clip counts too, as it does on the DAC.
+	 */
+	Unsaturated::EnvelopeFollower envelope(attack, release);
+	std::vector<uint8_t> track;
+	std::vector<int16_t> samples;
+	uint32_t length = wav.numSamples(), start = 0, block = 0;
+	wav.seek(0);
+	while ((uint64_t)track.size() * wav.sampleRate() / frameRate < length) {
+		uint64_t end = (uint64_t)(track.size() + 1) * wav.sampleRate() / frameRate;
+		if (end > length) end = length;
+		for (;;) {
+			uint64_t blockEnd = (uint64_t)(block + 1) * AUDIO_BLOCK * wav.sampleRate() / AUDIO_RATE;
+			if (blockEnd > length) blockEnd = length;
+			if (blockEnd > end || blockEnd <= start) break;
+			samples.resize(blockEnd - start);
+			uint32_t bytes = wav.read(samples.data(), samples.size() * sizeof(int16_t));
+			envelope.add(samples.data(), bytes / sizeof(int16_t));
+			start = blockEnd;
+			block++;
+		}
+		track.push_back(jawAngle(envelope.level()));
+	}
+	if (track.size() & 1) {
+		track.push_back(track.back()); /* Keep the chunk word-aligned */
+	}
+	wav.close();
+
+	JawTrackHeader jaw = { (uint16_t)frameRate, 0 };
+	if (!writeWithTrack(argv[1], argv[2], jaw, track)) {
+		fprintf(stderr, "failed writing %s\n", argv[2]);
+		return 1;
+	}
+	printf("%s: %u frames @ %uHz\n", argv[2], (unsigned)track.size(), frameRate);
+	return 0;
+}